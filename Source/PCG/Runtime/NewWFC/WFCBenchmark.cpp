@@ -0,0 +1,448 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "WFCBenchmark.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Engine/StaticMesh.h"
+#include "WFCCore.h"
+#include "WFCReplay.h"
+#include "WFCTileSet.h"
+
+namespace
+{
+	const TCHAR* GetPropagatorModeName(EWFCPropagatorMode Mode)
+	{
+		return Mode == EWFCPropagatorMode::SupportCount ? TEXT("SupportCount") : TEXT("Bitset");
+	}
+
+	const TCHAR* GetGenerationModeName(EWFCGenerationMode Mode)
+	{
+		switch (Mode)
+		{
+		case EWFCGenerationMode::GroundFirst: return TEXT("GroundFirst");
+		case EWFCGenerationMode::LayeredBottomUp: return TEXT("LayeredBottomUp");
+		case EWFCGenerationMode::CenterOutward: return TEXT("CenterOutward");
+		case EWFCGenerationMode::Custom: return TEXT("Custom");
+		default: return TEXT("Random");
+		}
+	}
+
+	constexpr EWFCGenerationMode SuiteGenerationModes[] = {
+		EWFCGenerationMode::Random, EWFCGenerationMode::GroundFirst, EWFCGenerationMode::LayeredBottomUp,
+		EWFCGenerationMode::CenterOutward, EWFCGenerationMode::Custom
+	};
+
+	FWFCSuiteCaseResult RunSuiteCase(UWFCTileSet* TileSet, const FString& TileSetName, const FIntVector& GridSize,
+	                                 EWFCGenerationMode Mode, bool bBacktracking, const FWFCSuiteSettings& Settings)
+	{
+		FWFCSuiteCaseResult Result;
+		Result.TileSetName = TileSetName;
+		Result.TileCount = TileSet->GetTileCount();
+		Result.GridSize = GridSize;
+		Result.GenerationMode = Mode;
+		Result.bBacktracking = bBacktracking;
+
+		FWFCConfiguration Config = TileSet->DefaultConfiguration;
+		Config.GridSize = GridSize;
+		Config.GenerationMode = Mode;
+		Config.bEnableBacktracking = bBacktracking;
+		Config.MaxIterations = FMath::Max(Config.MaxIterations, GridSize.X * GridSize.Y * GridSize.Z * 4);
+
+		for (int32 Run = 0; Run < Settings.Runs; Run++)
+		{
+			Config.RandomSeed = Settings.Seed + Run;
+
+			FWFCCore Core;
+			if (!Core.Initialize(TileSet, Config))
+			{
+				UE_LOG(LogTemp, Error, TEXT("WFCBenchmark: Core initialization failed for %s"), *TileSetName);
+				break;
+			}
+
+			const double StartTime = FPlatformTime::Seconds();
+			const FWFCGenerationResult GenerationResult = Core.Generate();
+			const double Elapsed = FPlatformTime::Seconds() - StartTime;
+
+			Result.MinSeconds = Result.Runs == 0 ? Elapsed : FMath::Min(Result.MinSeconds, Elapsed);
+			Result.MaxSeconds = FMath::Max(Result.MaxSeconds, Elapsed);
+			Result.TotalSeconds += Elapsed;
+			Result.TotalIterations += GenerationResult.IterationsUsed;
+			Result.TotalPropagations += Core.GetStats().Propagations;
+			Result.TotalRetries += Core.GetStats().Retries;
+			Result.SolverBytes = FMath::Max<uint64>(Result.SolverBytes, Core.GetAllocatedSize());
+			if (const TSharedPtr<const FWFCCompiledTileSet> Compiled = Core.GetCompiledTileSet())
+			{
+				Result.CompiledTileSetBytes = Compiled->GetAllocatedSize();
+			}
+			Result.Runs++;
+			if (GenerationResult.bSuccess)
+			{
+				Result.Successes++;
+			}
+		}
+		return Result;
+	}
+
+	FString FormatSuiteCsvRow(const FWFCSuiteCaseResult& Result)
+	{
+		const double AverageSeconds = Result.Runs > 0 ? Result.TotalSeconds / Result.Runs : 0.0;
+		const double AverageIterations = Result.Runs > 0 ? static_cast<double>(Result.TotalIterations) / Result.Runs : 0.0;
+		const double PropagationsPerSecond = Result.TotalSeconds > 0.0 ? Result.TotalPropagations / Result.TotalSeconds : 0.0;
+		return FString::Printf(TEXT("%s,%d,%d,%d,%d,%s,%d,%d,%d,%.6f,%.6f,%.6f,%.1f,%.0f,%d,%.2f,%.2f\n"),
+		                       *Result.TileSetName, Result.TileCount, Result.GridSize.X, Result.GridSize.Y,
+		                       Result.GridSize.Z, GetGenerationModeName(Result.GenerationMode),
+		                       Result.bBacktracking ? 1 : 0, Result.Runs, Result.Successes, AverageSeconds,
+		                       Result.MinSeconds, Result.MaxSeconds, AverageIterations, PropagationsPerSecond,
+		                       Result.TotalRetries, Result.SolverBytes / (1024.0 * 1024.0),
+		                       Result.CompiledTileSetBytes / (1024.0 * 1024.0));
+	}
+
+	void BenchmarkSuiteCommand(const TArray<FString>& Args)
+	{
+		UWFCTileSet* TileSet = nullptr;
+		if (Args.Num() >= 1 && !Args[0].Equals(TEXT("None"), ESearchCase::IgnoreCase))
+		{
+			TileSet = LoadObject<UWFCTileSet>(nullptr, *Args[0]);
+			if (!TileSet)
+			{
+				UE_LOG(LogTemp, Error, TEXT("WFCBenchmark: Failed to load tile set %s"), *Args[0]);
+				return;
+			}
+		}
+
+		FWFCSuiteSettings Settings;
+		if (Args.Num() >= 2)
+		{
+			Settings.Runs = FMath::Max(1, FCString::Atoi(*Args[1]));
+		}
+		if (Args.Num() >= 3)
+		{
+			Settings.MaxGridCells = FCString::Atoi(*Args[2]);
+		}
+		if (Args.Num() >= 4)
+		{
+			Settings.Seed = FCString::Atoi(*Args[3]);
+		}
+
+		FWFCBenchmark::RunSuite(TileSet, Settings, FWFCBenchmark::GetDefaultCsvPath());
+	}
+
+	FAutoConsoleCommand GWFCBenchmarkSuiteCommand(
+		TEXT("wfc.BenchmarkSuite"),
+		TEXT("Run the headless WFC benchmark matrix and write a CSV to Saved/WFCBenchmark. ")
+		TEXT("Usage: wfc.BenchmarkSuite [TileSetPath|None] [Runs] [MaxGridCells] [Seed]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkSuiteCommand));
+
+	void BenchmarkPropagatorsCommand(const TArray<FString>& Args)
+	{
+		if (Args.Num() < 1)
+		{
+			UE_LOG(LogTemp, Warning,
+			       TEXT("Usage: wfc.BenchmarkPropagators <TileSetPath> [SizeX SizeY SizeZ] [Runs] [Seed]"));
+			return;
+		}
+
+		UWFCTileSet* TileSet = LoadObject<UWFCTileSet>(nullptr, *Args[0]);
+		if (!TileSet)
+		{
+			UE_LOG(LogTemp, Error, TEXT("WFCBenchmark: Failed to load tile set %s"), *Args[0]);
+			return;
+		}
+
+		FWFCConfiguration Config = TileSet->DefaultConfiguration;
+		Config.GridSize = FIntVector(20, 20, 8);
+		if (Args.Num() >= 4)
+		{
+			Config.GridSize = FIntVector(FCString::Atoi(*Args[1]), FCString::Atoi(*Args[2]), FCString::Atoi(*Args[3]));
+		}
+		const int32 Runs = Args.Num() >= 5 ? FMath::Max(1, FCString::Atoi(*Args[4])) : 5;
+		if (Args.Num() >= 6)
+		{
+			Config.RandomSeed = FCString::Atoi(*Args[5]);
+		}
+
+		FWFCBenchmark::ComparePropagators(TileSet, Config, Runs);
+	}
+
+	FAutoConsoleCommand GWFCBenchmarkPropagatorsCommand(
+		TEXT("wfc.BenchmarkPropagators"),
+		TEXT("Compare the Bitset and SupportCount WFC propagators. ")
+		TEXT("Usage: wfc.BenchmarkPropagators <TileSetPath> [SizeX SizeY SizeZ] [Runs] [Seed]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkPropagatorsCommand));
+
+	void ReplayCommand(const TArray<FString>& Args)
+	{
+		if (Args.Num() < 1)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Usage: wfc.Replay <ReplayFile> [Runs] [TileSetPath]"));
+			return;
+		}
+
+		UWFCTileSet* TileSet = nullptr;
+		if (Args.Num() >= 3)
+		{
+			TileSet = LoadObject<UWFCTileSet>(nullptr, *Args[2]);
+			if (!TileSet)
+			{
+				UE_LOG(LogTemp, Error, TEXT("WFCBenchmark: Failed to load tile set %s"), *Args[2]);
+				return;
+			}
+		}
+		const int32 Runs = Args.Num() >= 2 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 1;
+
+		FWFCBenchmark::RunReplay(TileSet, Args[0], Runs);
+	}
+
+	FAutoConsoleCommand GWFCReplayCommand(
+		TEXT("wfc.Replay"),
+		TEXT("Replay a recorded WFC generation and check that it is reproduced exactly. ")
+		TEXT("Usage: wfc.Replay <ReplayFile> [Runs] [TileSetPath]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&ReplayCommand));
+}
+
+FWFCPropagatorBenchmarkResult FWFCBenchmark::RunPropagator(UWFCTileSet* TileSet, const FWFCConfiguration& Config,
+                                                           EWFCPropagatorMode Mode, int32 Runs)
+{
+	FWFCPropagatorBenchmarkResult Result;
+	Result.Mode = Mode;
+
+	FWFCConfiguration RunConfig = Config;
+	RunConfig.PropagatorMode = Mode;
+
+	for (int32 Run = 0; Run < Runs; Run++)
+	{
+		//两种模式使用相同的种子序列
+		RunConfig.RandomSeed = Config.RandomSeed + Run;
+
+		FWFCCore Core;
+		if (!Core.Initialize(TileSet, RunConfig))
+		{
+			UE_LOG(LogTemp, Error, TEXT("WFCBenchmark: Core initialization failed"));
+			break;
+		}
+
+		const double StartTime = FPlatformTime::Seconds();
+		const FWFCGenerationResult GenerationResult = Core.Generate();
+		const double Elapsed = FPlatformTime::Seconds() - StartTime;
+
+		Result.MinSeconds = Result.Runs == 0 ? Elapsed : FMath::Min(Result.MinSeconds, Elapsed);
+		Result.MaxSeconds = FMath::Max(Result.MaxSeconds, Elapsed);
+		Result.TotalSeconds += Elapsed;
+		Result.Runs++;
+		if (GenerationResult.bSuccess)
+		{
+			Result.Successes++;
+		}
+	}
+
+	return Result;
+}
+
+void FWFCBenchmark::ComparePropagators(UWFCTileSet* TileSet, const FWFCConfiguration& Config, int32 Runs)
+{
+	if (!TileSet)
+	{
+		UE_LOG(LogTemp, Error, TEXT("WFCBenchmark: TileSet is null"));
+		return;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("WFCBenchmark: %d tiles, grid size %s, %d runs from seed %d"),
+	       TileSet->GetTileCount(), *Config.GridSize.ToString(), Runs, Config.RandomSeed);
+
+	for (EWFCPropagatorMode Mode : {EWFCPropagatorMode::Bitset, EWFCPropagatorMode::SupportCount})
+	{
+		const FWFCPropagatorBenchmarkResult Result = RunPropagator(TileSet, Config, Mode, Runs);
+		UE_LOG(LogTemp, Log, TEXT("WFCBenchmark: %-12s avg %.4fs, min %.4fs, max %.4fs, %d/%d succeeded"),
+		       GetPropagatorModeName(Mode), Result.GetAverageSeconds(), Result.MinSeconds, Result.MaxSeconds,
+		       Result.Successes, Result.Runs);
+	}
+}
+
+UWFCTileSet* FWFCBenchmark::CreateSyntheticTileSet(int32 TileCount, int32 SocketCount, int32 Seed)
+{
+	UWFCTileSet* TileSet = NewObject<UWFCTileSet>(GetTransientPackage());
+	TileSet->TileSetName = FString::Printf(TEXT("Synthetic%d"), TileCount);
+
+	SocketCount = FMath::Max(SocketCount, 1);
+	for (int32 SocketIndex = 0; SocketIndex < SocketCount; SocketIndex++)
+	{
+		//以s结尾的Socket只与同名Socket兼容
+		TileSet->SocketDefinitions.Add(FWFCSocket(FString::Printf(TEXT("%ds"), SocketIndex)));
+	}
+
+	//只用于通过TileSet校验，基准不创建可视化
+	UStaticMesh* PlaceholderMesh = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+	if (!PlaceholderMesh)
+	{
+		UE_LOG(LogTemp, Error, TEXT("WFCBenchmark: Failed to load placeholder mesh for synthetic tile set"));
+	}
+
+	FRandomStream Random(Seed);
+	for (int32 TileIndex = 0; TileIndex < TileCount; TileIndex++)
+	{
+		FWFCTileDefinition Tile;
+		Tile.TileName = FString::Printf(TEXT("Synthetic_%d"), TileIndex);
+		Tile.Mesh = PlaceholderMesh;
+		Tile.Category = TileIndex == 0 ? EWFCTileCategory::Empty : EWFCTileCategory::Unknown;
+		Tile.Weight = TileIndex == 0 ? 1.0f : Random.FRandRange(0.5f, 2.5f);
+		Tile.bCanRotate = false;
+		for (int32 Dir = 0; Dir < 6; Dir++)
+		{
+			const int32 SocketIndex = TileIndex == 0 ? 0 : Random.RandHelper(SocketCount);
+			Tile.SetSocket(static_cast<EWFCDirection>(Dir), TileSet->SocketDefinitions[SocketIndex].SocketName);
+		}
+		TileSet->Tiles.Add(Tile);
+	}
+
+	TileSet->BuildSocketTable();
+	return TileSet;
+}
+
+bool FWFCBenchmark::RunSuite(UWFCTileSet* ShippedTileSet, const FWFCSuiteSettings& Settings, const FString& CsvPath)
+{
+	TArray<TPair<FString, UWFCTileSet*>> TileSets;
+	if (ShippedTileSet)
+	{
+		TileSets.Emplace(ShippedTileSet->GetName(), ShippedTileSet);
+	}
+	for (const int32 TileCount : Settings.SyntheticTileCounts)
+	{
+		UWFCTileSet* Synthetic = CreateSyntheticTileSet(TileCount, 4, Settings.Seed);
+		TileSets.Emplace(Synthetic->TileSetName, Synthetic);
+	}
+
+	FString Csv = TEXT("TileSet,Tiles,GridX,GridY,GridZ,GenerationMode,Backtracking,Runs,Successes,")
+		TEXT("AvgSeconds,MinSeconds,MaxSeconds,AvgIterations,PropagationsPerSecond,Retries,SolverMB,CompiledTileSetMB\n");
+
+	int32 CaseCount = 0;
+	for (const auto& [TileSetName, TileSet] : TileSets)
+	{
+		for (const FIntVector& GridSize : Settings.GridSizes)
+		{
+			if (Settings.MaxGridCells > 0 && GridSize.X * GridSize.Y * GridSize.Z > Settings.MaxGridCells)
+			{
+				continue;
+			}
+
+			for (const EWFCGenerationMode Mode : SuiteGenerationModes)
+			{
+				for (const bool bBacktracking : {false, true})
+				{
+					const FWFCSuiteCaseResult Result = RunSuiteCase(TileSet, TileSetName, GridSize, Mode, bBacktracking,
+					                                                Settings);
+					Csv += FormatSuiteCsvRow(Result);
+					CaseCount++;
+
+					UE_LOG(LogTemp, Log, TEXT("WFCBenchmark: %s %s %s bt=%d avg %.4fs, %d/%d succeeded"),
+					       *TileSetName, *GridSize.ToString(), GetGenerationModeName(Mode), bBacktracking ? 1 : 0,
+					       Result.Runs > 0 ? Result.TotalSeconds / Result.Runs : 0.0, Result.Successes, Result.Runs);
+				}
+			}
+		}
+	}
+
+	if (!FFileHelper::SaveStringToFile(Csv, *CsvPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("WFCBenchmark: Failed to write %s"), *CsvPath);
+		return false;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("WFCBenchmark: Wrote %d cases to %s"), CaseCount, *CsvPath);
+	return true;
+}
+
+FString FWFCBenchmark::GetDefaultCsvPath()
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("WFCBenchmark"),
+	                       FString::Printf(TEXT("WFCBenchmark-%s.csv"), *FDateTime::Now().ToString()));
+}
+
+bool FWFCBenchmark::RunReplay(UWFCTileSet* TileSet, const FString& ReplayPath, int32 Runs)
+{
+	FWFCReplayLog Log;
+	if (!Log.LoadFromFile(ReplayPath))
+	{
+		return false;
+	}
+
+	if (!TileSet)
+	{
+		TileSet = LoadObject<UWFCTileSet>(nullptr, *Log.TileSetPath);
+		if (!TileSet)
+		{
+			UE_LOG(LogTemp, Error, TEXT("WFCBenchmark: Failed to load recorded tile set %s"), *Log.TileSetPath);
+			return false;
+		}
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("WFCBenchmark: Replaying %s - grid size %s, %d attempts, %d decisions, recorded %s"),
+	       *ReplayPath, *Log.Config.GridSize.ToString(), Log.Attempts.Num(), Log.Decisions.Num(),
+	       Log.bSuccess ? TEXT("success") : TEXT("failure"));
+
+	int32 ExactRuns = 0;
+	double TotalSeconds = 0.0;
+	double MaxSeconds = 0.0;
+	for (int32 Run = 0; Run < Runs; Run++)
+	{
+		FWFCCore Core;
+		FWFCGenerationResult Result;
+		const bool bExact = Core.ReplayGeneration(TileSet, Log, Result);
+		TotalSeconds += Result.GenerationTimeSeconds;
+		MaxSeconds = FMath::Max(MaxSeconds, static_cast<double>(Result.GenerationTimeSeconds));
+		if (bExact)
+		{
+			ExactRuns++;
+		}
+
+		UE_LOG(LogTemp, Log, TEXT("WFCBenchmark: Replay run %d %s in %.4fs - %lld propagations, %d backtracks, %d retries"),
+		       Run, bExact ? TEXT("exact") : TEXT("DIVERGED"), Result.GenerationTimeSeconds,
+		       Result.Stats.Propagations, Result.Stats.Backtracks, Result.Stats.Retries);
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("WFCBenchmark: Replay avg %.4fs, max %.4fs, %d/%d exact"),
+	       Runs > 0 ? TotalSeconds / Runs : 0.0, MaxSeconds, ExactRuns, Runs);
+	return ExactRuns == Runs;
+}
+
+UWFCBenchmarkCommandlet::UWFCBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UWFCBenchmarkCommandlet::Main(const FString& Params)
+{
+	UWFCTileSet* TileSet = nullptr;
+	FString TileSetPath;
+	if (FParse::Value(*Params, TEXT("TileSet="), TileSetPath))
+	{
+		TileSet = LoadObject<UWFCTileSet>(nullptr, *TileSetPath);
+		if (!TileSet)
+		{
+			UE_LOG(LogTemp, Error, TEXT("WFCBenchmark: Failed to load tile set %s"), *TileSetPath);
+			return 1;
+		}
+	}
+
+	FWFCSuiteSettings Settings;
+	FParse::Value(*Params, TEXT("Runs="), Settings.Runs);
+
+	FString ReplayPath;
+	if (FParse::Value(*Params, TEXT("Replay="), ReplayPath))
+	{
+		return FWFCBenchmark::RunReplay(TileSet, ReplayPath, FMath::Max(1, Settings.Runs)) ? 0 : 1;
+	}
+
+	FParse::Value(*Params, TEXT("Seed="), Settings.Seed);
+	FParse::Value(*Params, TEXT("MaxCells="), Settings.MaxGridCells);
+	Settings.Runs = FMath::Max(1, Settings.Runs);
+
+	FString CsvPath = FWFCBenchmark::GetDefaultCsvPath();
+	FParse::Value(*Params, TEXT("Output="), CsvPath);
+
+	return FWFCBenchmark::RunSuite(TileSet, Settings, CsvPath) ? 0 : 1;
+}
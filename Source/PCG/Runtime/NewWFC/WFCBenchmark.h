@@ -0,0 +1,89 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "WFCTypes.h"
+#include "WFCBenchmark.generated.h"
+
+class UWFCTileSet;
+
+struct FWFCPropagatorBenchmarkResult
+{
+    EWFCPropagatorMode Mode = EWFCPropagatorMode::Bitset;
+    int32 Runs = 0;
+    int32 Successes = 0;
+    double TotalSeconds = 0.0;
+    double MinSeconds = 0.0;
+    double MaxSeconds = 0.0;
+
+    double GetAverageSeconds() const { return Runs > 0 ? TotalSeconds / Runs : 0.0; }
+};
+
+//基准矩阵中一个组合在Runs次运行上的汇总
+struct FWFCSuiteCaseResult
+{
+    FString TileSetName;
+    int32 TileCount = 0;
+    FIntVector GridSize = FIntVector::ZeroValue;
+    EWFCGenerationMode GenerationMode = EWFCGenerationMode::Random;
+    bool bBacktracking = false;
+    int32 Runs = 0;
+    int32 Successes = 0;
+    double TotalSeconds = 0.0;
+    double MinSeconds = 0.0;
+    double MaxSeconds = 0.0;
+    int64 TotalIterations = 0;
+    int64 TotalPropagations = 0;
+    int32 TotalRetries = 0;
+    //各次运行中求解器自身数据的最大值，以及共享的编译瓦片集大小
+    uint64 SolverBytes = 0;
+    uint64 CompiledTileSetBytes = 0;
+};
+
+struct FWFCSuiteSettings
+{
+    int32 Runs = 3;
+    int32 Seed = 1;
+    //超过该格子数的网格尺寸跳过，0表示不限制
+    int32 MaxGridCells = 0;
+    TArray<int32> SyntheticTileCounts = {50, 200, 800};
+    TArray<FIntVector> GridSizes = {
+        FIntVector(5, 5, 3), FIntVector(10, 10, 3), FIntVector(20, 20, 7), FIntVector(32, 32, 8), FIntVector(64, 64, 8)
+    };
+};
+
+//对比不同传播器在同一TileSet、同一组种子下的生成耗时
+class PCG_API FWFCBenchmark
+{
+public:
+    static FWFCPropagatorBenchmarkResult RunPropagator(UWFCTileSet* TileSet, const FWFCConfiguration& Config,
+                                                       EWFCPropagatorMode Mode, int32 Runs);
+
+    static void ComparePropagators(UWFCTileSet* TileSet, const FWFCConfiguration& Config, int32 Runs);
+
+    //0号为六面全"0s"的空瓦片，其余瓦片的Socket从SocketCount个自兼容Socket中随机选取
+    static UWFCTileSet* CreateSyntheticTileSet(int32 TileCount, int32 SocketCount, int32 Seed);
+
+    //TileSet×网格尺寸×生成模式×回溯开关的全组合，不创建World与可视化，结果写入CSV
+    static bool RunSuite(UWFCTileSet* ShippedTileSet, const FWFCSuiteSettings& Settings, const FString& CsvPath);
+
+    static FString GetDefaultCsvPath();
+
+    //按重放日志重复生成Runs次并校验逐位一致，TileSet为空时按日志中的路径加载
+    static bool RunReplay(UWFCTileSet* TileSet, const FString& ReplayPath, int32 Runs);
+};
+
+//无界面运行基准：-run=WFCBenchmark [-TileSet=<Path>] [-Runs=N] [-Seed=N] [-MaxCells=N] [-Output=<File>]
+//指定-Replay=<File>时只重放该日志：-run=WFCBenchmark -Replay=<File> [-TileSet=<Path>] [-Runs=N]
+UCLASS()
+class PCG_API UWFCBenchmarkCommandlet : public UCommandlet
+{
+    GENERATED_BODY()
+
+public:
+    UWFCBenchmarkCommandlet();
+
+    virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,481 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "WFCCompiledTileSet.h"
+
+#include "WFCTileMask.h"
+#include "WFCTileSet.h"
+
+namespace
+{
+	//只保存弱引用，没有求解器使用的编译结果随之释放
+	FCriticalSection GCompiledTileSetLock;
+	TMap<uint32, TWeakPtr<const FWFCCompiledTileSet>> GCompiledTileSets;
+
+	TSharedPtr<const FWFCCompiledTileSet> FindCached(uint32 ContentHash)
+	{
+		FScopeLock Lock(&GCompiledTileSetLock);
+		const TWeakPtr<const FWFCCompiledTileSet>* Found = GCompiledTileSets.Find(ContentHash);
+		return Found ? Found->Pin() : nullptr;
+	}
+
+	constexpr uint32 BlobMagic = 0x52434657; //"WFCR"
+	constexpr uint32 BlobVersion = 1;
+
+	struct FBlobHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint32 ContentHash;
+		int32 NumTiles;
+		int32 NumMaskWords;
+		int32 NumSockets;
+		int32 SocketMatrixWords;
+	};
+
+	void WriteBytes(TArray<uint8>& Blob, const void* Data, int64 Size)
+	{
+		const int32 Offset = Blob.AddUninitialized(Size);
+		FMemory::Memcpy(Blob.GetData() + Offset, Data, Size);
+	}
+
+	template <typename T>
+	void WriteArray(TArray<uint8>& Blob, const TArray<T>& Array)
+	{
+		WriteBytes(Blob, Array.GetData(), Array.Num() * sizeof(T));
+	}
+
+	bool ReadBytes(const TArray<uint8>& Blob, int64& Offset, void* Data, int64 Size)
+	{
+		if (Size < 0 || Offset + Size > Blob.Num())
+		{
+			return false;
+		}
+		FMemory::Memcpy(Data, Blob.GetData() + Offset, Size);
+		Offset += Size;
+		return true;
+	}
+
+	//最后一个字中超出位数的位必须为0，否则按位遍历会得到越界的瓦片下标
+	bool HasClearPadding(const TArray<uint64>& Words, int32 WordsPerMask, int32 NumBits)
+	{
+		const int32 UsedBits = NumBits % 64;
+		if (UsedBits == 0 || WordsPerMask == 0)
+		{
+			return true;
+		}
+		const uint64 PaddingMask = ~0ull << UsedBits;
+		for (int32 Last = WordsPerMask - 1; Last < Words.Num(); Last += WordsPerMask)
+		{
+			if (Words[Last] & PaddingMask)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template <typename T>
+	bool ReadArray(const TArray<uint8>& Blob, int64& Offset, TArray<T>& Array, int32 Num)
+	{
+		if (Num < 0)
+		{
+			return false;
+		}
+		Array.SetNumUninitialized(Num);
+		return ReadBytes(Blob, Offset, Array.GetData(), Num * sizeof(T));
+	}
+}
+
+TSharedPtr<const FWFCCompiledTileSet> FWFCCompiledTileSet::FindOrBuild(const UWFCTileSet& TileSet)
+{
+	const uint32 ContentHash = ComputeContentHash(TileSet);
+
+	//哈希碰撞时逐项比较，不一致就重建覆盖；比较和编译都不持有锁
+	const TSharedPtr<const FWFCCompiledTileSet> Cached = FindCached(ContentHash);
+	if (Cached && Cached->Matches(TileSet))
+	{
+		return Cached;
+	}
+
+	//优先使用资产中烘焙的数据，过期（哈希或内容不一致）时再现场编译
+	TSharedRef<FWFCCompiledTileSet> Compiled = MakeShared<FWFCCompiledTileSet>();
+	if (TileSet.CompiledRulesBlob.Num() > 0 && Compiled->LoadFromBlob(TileSet.CompiledRulesBlob) &&
+		Compiled->ContentHash == ContentHash && Compiled->Matches(TileSet))
+	{
+		UE_LOG(LogTemp, Log, TEXT("WFCCompiledTileSet: Loaded baked rules of %s (%d tiles, %d bytes)"),
+		       *TileSet.GetName(), Compiled->NumTiles, TileSet.CompiledRulesBlob.Num());
+	}
+	else
+	{
+		Compiled->Build(TileSet);
+		Compiled->ContentHash = ContentHash;
+		UE_LOG(LogTemp, Log, TEXT("WFCCompiledTileSet: Compiled %s (%d tiles, %d sockets)"),
+		       *TileSet.GetName(), Compiled->NumTiles, Compiled->SocketNames.Num());
+	}
+
+	const TSharedPtr<const FWFCCompiledTileSet> Result = Compiled;
+	FScopeLock Lock(&GCompiledTileSetLock);
+	//其他线程同时编译了同一份数据时沿用先放入的，保证共享
+	if (const TWeakPtr<const FWFCCompiledTileSet>* Found = GCompiledTileSets.Find(ContentHash))
+	{
+		const TSharedPtr<const FWFCCompiledTileSet> Existing = Found->Pin();
+		if (Existing && Existing != Cached && Existing->Matches(TileSet))
+		{
+			return Existing;
+		}
+	}
+
+	TArray<uint32> StaleHashes;
+	for (const auto& [Hash, Entry] : GCompiledTileSets)
+	{
+		if (!Entry.IsValid())
+		{
+			StaleHashes.Add(Hash);
+		}
+	}
+	for (const uint32 Hash : StaleHashes)
+	{
+		GCompiledTileSets.Remove(Hash);
+	}
+
+	GCompiledTileSets.Add(ContentHash, Result);
+	return Result;
+}
+
+void FWFCCompiledTileSet::ClearCache()
+{
+	FScopeLock Lock(&GCompiledTileSetLock);
+	GCompiledTileSets.Empty();
+}
+
+uint32 FWFCCompiledTileSet::ComputeContentHash(const UWFCTileSet& TileSet)
+{
+	uint32 Hash = GetTypeHash(TileSet.GetTileCount());
+	for (const FWFCTileDefinition& TileDef : TileSet.Tiles)
+	{
+		Hash = HashCombineFast(Hash, GetTypeHash(TileDef.Weight));
+		Hash = HashCombineFast(Hash, GetTypeHash(static_cast<uint8>(TileDef.Category)));
+		Hash = HashCombineFast(Hash, GetTypeHash(TileDef.MaxInstancesPerGeneration));
+		Hash = HashCombineFast(Hash, GetTypeHash(TileDef.bRequiresSupport));
+		for (int32 Dir = 0; Dir < 6; Dir++)
+		{
+			Hash = HashCombineFast(Hash, GetTypeHash(TileDef.GetSocket(static_cast<EWFCDirection>(Dir))));
+		}
+	}
+	return Hash;
+}
+
+bool FWFCCompiledTileSet::Matches(const UWFCTileSet& TileSet) const
+{
+	if (NumTiles != TileSet.GetTileCount())
+	{
+		return false;
+	}
+
+	for (int32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+	{
+		const FWFCTileDefinition& TileDef = TileSet.Tiles[TileIndex];
+		if (Weights[TileIndex] != TileDef.Weight || Categories[TileIndex] != TileDef.Category ||
+			MaxInstances[TileIndex] != TileDef.MaxInstancesPerGeneration ||
+			RequiresSupport[TileIndex] != TileDef.bRequiresSupport)
+		{
+			return false;
+		}
+		for (int32 Dir = 0; Dir < 6; Dir++)
+		{
+			if (!SocketNames[GetSocketId(TileIndex, Dir)].Equals(TileDef.GetSocket(static_cast<EWFCDirection>(Dir)),
+			                                                     ESearchCase::IgnoreCase))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void FWFCCompiledTileSet::SaveToBlob(TArray<uint8>& OutBlob) const
+{
+	OutBlob.Reset();
+
+	FBlobHeader Header;
+	Header.Magic = BlobMagic;
+	Header.Version = BlobVersion;
+	Header.ContentHash = ContentHash;
+	Header.NumTiles = NumTiles;
+	Header.NumMaskWords = NumMaskWords;
+	Header.NumSockets = SocketNames.Num();
+	Header.SocketMatrixWords = SocketMatrixWords;
+	WriteBytes(OutBlob, &Header, sizeof(Header));
+
+	WriteArray(OutBlob, Weights);
+	WriteArray(OutBlob, WeightLogWeights);
+	WriteArray(OutBlob, Categories);
+	WriteArray(OutBlob, MaxInstances);
+	WriteArray(OutBlob, RequiresSupport);
+	WriteArray(OutBlob, SocketIds);
+	WriteArray(OutBlob, SocketCompatibility);
+	WriteArray(OutBlob, GroundTileMask);
+	WriteArray(OutBlob, EmptyTileMask);
+	WriteArray(OutBlob, CompatibilityMasks);
+	WriteArray(OutBlob, InitialSupportCounts);
+
+	//Socket名只在日志和校验中使用，按UTF-8长度前缀存放
+	for (const FString& SocketName : SocketNames)
+	{
+		FTCHARToUTF8 Utf8(*SocketName);
+		const int32 Length = Utf8.Length();
+		WriteBytes(OutBlob, &Length, sizeof(Length));
+		WriteBytes(OutBlob, Utf8.Get(), Length);
+	}
+}
+
+bool FWFCCompiledTileSet::LoadFromBlob(const TArray<uint8>& Blob)
+{
+	Empty();
+
+	int64 Offset = 0;
+	FBlobHeader Header;
+	if (!ReadBytes(Blob, Offset, &Header, sizeof(Header)) || Header.Magic != BlobMagic || Header.Version != BlobVersion)
+	{
+		return false;
+	}
+
+	const int32 Tiles = Header.NumTiles;
+	bool bRead = Tiles >= 0 && Header.NumMaskWords == FWFCTileMask::GetNumWords(Tiles) && Header.NumSockets >= 0 &&
+		Header.SocketMatrixWords >= 0;
+	bRead = bRead && ReadArray(Blob, Offset, Weights, Tiles);
+	bRead = bRead && ReadArray(Blob, Offset, WeightLogWeights, Tiles);
+	bRead = bRead && ReadArray(Blob, Offset, Categories, Tiles);
+	bRead = bRead && ReadArray(Blob, Offset, MaxInstances, Tiles);
+	bRead = bRead && ReadArray(Blob, Offset, RequiresSupport, Tiles);
+	bRead = bRead && ReadArray(Blob, Offset, SocketIds, Tiles * 6);
+	bRead = bRead && ReadArray(Blob, Offset, SocketCompatibility, Header.NumSockets * Header.SocketMatrixWords);
+	bRead = bRead && ReadArray(Blob, Offset, GroundTileMask, Header.NumMaskWords);
+	bRead = bRead && ReadArray(Blob, Offset, EmptyTileMask, Header.NumMaskWords);
+	bRead = bRead && ReadArray(Blob, Offset, CompatibilityMasks, 6 * Tiles * Header.NumMaskWords);
+	bRead = bRead && ReadArray(Blob, Offset, InitialSupportCounts, Tiles * 6);
+
+	SocketNames.Reserve(Header.NumSockets);
+	TArray<uint8> NameBytes;
+	for (int32 SocketIndex = 0; bRead && SocketIndex < Header.NumSockets; SocketIndex++)
+	{
+		int32 Length = 0;
+		bRead = ReadBytes(Blob, Offset, &Length, sizeof(Length)) && ReadArray(Blob, Offset, NameBytes, Length);
+		if (bRead)
+		{
+			FUTF8ToTCHAR Converter(reinterpret_cast<const ANSICHAR*>(NameBytes.GetData()), Length);
+			SocketNames.Add(FString(Converter.Length(), Converter.Get()));
+		}
+	}
+
+	if (!bRead || Offset != Blob.Num())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WFCCompiledTileSet: Baked rules blob is corrupted (%d bytes)"), Blob.Num());
+		Empty();
+		return false;
+	}
+
+	//Socket表或掩码越界的旧数据交给FindOrBuild重新编译
+	bool bInRange = Header.SocketMatrixWords == FMath::Max(1, (Header.NumSockets + 63) / 64);
+	for (int32 Index = 0; bInRange && Index < SocketIds.Num(); Index++)
+	{
+		bInRange = SocketIds[Index] >= 0 && SocketIds[Index] < Header.NumSockets;
+	}
+	bInRange = bInRange && HasClearPadding(CompatibilityMasks, Header.NumMaskWords, Tiles) &&
+		HasClearPadding(GroundTileMask, Header.NumMaskWords, Tiles) && HasClearPadding(EmptyTileMask, Header.NumMaskWords, Tiles) &&
+		HasClearPadding(SocketCompatibility, Header.SocketMatrixWords, Header.NumSockets);
+	if (!bInRange)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WFCCompiledTileSet: Baked rules reference sockets or tiles out of range (%d sockets)"),
+		       Header.NumSockets);
+		Empty();
+		return false;
+	}
+
+	NumTiles = Tiles;
+	NumMaskWords = Header.NumMaskWords;
+	SocketMatrixWords = Header.SocketMatrixWords;
+	ContentHash = Header.ContentHash;
+	return true;
+}
+
+void FWFCCompiledTileSet::Build(const UWFCTileSet& TileSet)
+{
+	Empty();
+
+	NumTiles = TileSet.GetTileCount();
+	NumMaskWords = FWFCTileMask::GetNumWords(NumTiles);
+
+	Weights.SetNumUninitialized(NumTiles);
+	WeightLogWeights.SetNumUninitialized(NumTiles);
+	Categories.SetNumUninitialized(NumTiles);
+	MaxInstances.SetNumUninitialized(NumTiles);
+	RequiresSupport.SetNumUninitialized(NumTiles);
+	GroundTileMask.SetNumZeroed(NumMaskWords);
+	EmptyTileMask.SetNumZeroed(NumMaskWords);
+
+	for (int32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+	{
+		const FWFCTileDefinition& TileDef = TileSet.Tiles[TileIndex];
+		const float Weight = TileDef.Weight;
+		Weights[TileIndex] = Weight;
+		WeightLogWeights[TileIndex] = Weight > 0.0f ? Weight * FMath::Loge(Weight) : 0.0f;
+		Categories[TileIndex] = TileDef.Category;
+		MaxInstances[TileIndex] = TileDef.MaxInstancesPerGeneration;
+		RequiresSupport[TileIndex] = TileDef.bRequiresSupport;
+
+		const uint64 Bit = 1ull << (TileIndex % FWFCTileMask::BitsPerWord);
+		if (TileDef.Category == EWFCTileCategory::Ground)
+		{
+			GroundTileMask[TileIndex / FWFCTileMask::BitsPerWord] |= Bit;
+		}
+		else if (TileDef.Category == EWFCTileCategory::Empty)
+		{
+			EmptyTileMask[TileIndex / FWFCTileMask::BitsPerWord] |= Bit;
+		}
+	}
+
+	BuildSocketTable(TileSet);
+	BuildCompatibilityMasks();
+	ValidateCompatibilityMasks();
+}
+
+void FWFCCompiledTileSet::BuildSocketTable(const UWFCTileSet& TileSet)
+{
+	//资产里的Socket表过期时临时重建一份，不修改资产本身
+	if (TileSet.HasValidSocketTable())
+	{
+		SocketIds = TileSet.TileSocketIds;
+		SocketNames = TileSet.SocketNames;
+		SocketCompatibility = TileSet.SocketCompatibilityMatrix;
+		SocketMatrixWords = TileSet.SocketMatrixWords;
+		return;
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("WFCCompiledTileSet: Socket table of %s is stale, call BuildSocketTable to bake it"),
+	       *TileSet.GetName());
+
+	TMap<FString, int32> SocketLookup;
+	SocketIds.SetNumUninitialized(NumTiles * 6);
+	for (int32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+	{
+		for (int32 Dir = 0; Dir < 6; Dir++)
+		{
+			const FString Socket = TileSet.Tiles[TileIndex].GetSocket(static_cast<EWFCDirection>(Dir));
+			int32* SocketId = SocketLookup.Find(Socket);
+			if (!SocketId)
+			{
+				SocketId = &SocketLookup.Add(Socket, SocketNames.Add(Socket));
+			}
+			SocketIds[TileIndex * 6 + Dir] = *SocketId;
+		}
+	}
+
+	const int32 SocketCount = SocketNames.Num();
+	SocketMatrixWords = FMath::Max(1, (SocketCount + 63) / 64);
+	SocketCompatibility.SetNumZeroed(SocketCount * SocketMatrixWords);
+	for (int32 SocketA = 0; SocketA < SocketCount; SocketA++)
+	{
+		for (int32 SocketB = 0; SocketB < SocketCount; SocketB++)
+		{
+			if (TileSet.AreSocketsCompatible(SocketNames[SocketA], SocketNames[SocketB]))
+			{
+				SocketCompatibility[SocketA * SocketMatrixWords + SocketB / 64] |= 1ull << (SocketB % 64);
+			}
+		}
+	}
+}
+
+void FWFCCompiledTileSet::BuildCompatibilityMasks()
+{
+	CompatibilityMasks.Reset();
+	CompatibilityMasks.SetNumZeroed(6 * NumTiles * NumMaskWords);
+	InitialSupportCounts.SetNumZeroed(NumTiles * 6);
+
+	int32 TotalRules = 0;
+	for (int32 Dir = 0; Dir < 6; Dir++)
+	{
+		for (int32 TileA = 0; TileA < NumTiles; TileA++)
+		{
+			const int32 SocketA = GetSocketId(TileA, Dir);
+			uint64* Mask = CompatibilityMasks.GetData() + (Dir * NumTiles + TileA) * NumMaskWords;
+			for (int32 TileB = 0; TileB < NumTiles; TileB++)
+			{
+				if (AreSocketsCompatible(SocketA, GetSocketId(TileB, Dir ^ 1)))
+				{
+					Mask[TileB / FWFCTileMask::BitsPerWord] |= 1ull << (TileB % FWFCTileMask::BitsPerWord);
+				}
+			}
+
+			int32 Count = 0;
+			for (int32 Word = 0; Word < NumMaskWords; Word++)
+			{
+				Count += FMath::CountBits(Mask[Word]);
+			}
+			InitialSupportCounts[TileA * 6 + Dir] = Count;
+			TotalRules += Count;
+		}
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("WFCCompiledTileSet: Built %d propagation rules for %d tiles"), TotalRules, NumTiles);
+}
+
+void FWFCCompiledTileSet::ValidateCompatibilityMasks() const
+{
+	bool bFoundAsymmetry = false;
+	for (int32 Dir = 0; Dir < 6; Dir++)
+	{
+		for (int32 TileA = 0; TileA < NumTiles; TileA++)
+		{
+			FWFCTileMask::ForEachSetBit(GetCompatibilityMask(Dir, TileA), NumMaskWords, [&](int32 TileB)
+			{
+				const uint64* ReverseMask = GetCompatibilityMask(Dir ^ 1, TileB);
+				if (!(ReverseMask[TileA / FWFCTileMask::BitsPerWord] & (1ull << (TileA % FWFCTileMask::BitsPerWord))))
+				{
+					UE_LOG(LogTemp, Warning,
+					       TEXT("WFCCompiledTileSet: Asymmetric rule found - Tile %d -> %d in dir %d, but not reverse"),
+					       TileA, TileB, Dir);
+					bFoundAsymmetry = true;
+				}
+			});
+		}
+	}
+
+	if (!bFoundAsymmetry)
+	{
+		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCompiledTileSet: Propagation rules symmetry validation passed"));
+	}
+}
+
+SIZE_T FWFCCompiledTileSet::GetAllocatedSize() const
+{
+	SIZE_T Bytes = Weights.GetAllocatedSize() + WeightLogWeights.GetAllocatedSize() + Categories.GetAllocatedSize() +
+		MaxInstances.GetAllocatedSize() + RequiresSupport.GetAllocatedSize() + SocketIds.GetAllocatedSize() +
+		SocketNames.GetAllocatedSize() + SocketCompatibility.GetAllocatedSize() + GroundTileMask.GetAllocatedSize() +
+		EmptyTileMask.GetAllocatedSize() + CompatibilityMasks.GetAllocatedSize() + InitialSupportCounts.GetAllocatedSize();
+	for (const FString& SocketName : SocketNames)
+	{
+		Bytes += SocketName.GetAllocatedSize();
+	}
+	return Bytes;
+}
+
+void FWFCCompiledTileSet::Empty()
+{
+	NumTiles = 0;
+	ContentHash = 0;
+	NumMaskWords = 0;
+	Weights.Empty();
+	WeightLogWeights.Empty();
+	Categories.Empty();
+	MaxInstances.Empty();
+	RequiresSupport.Empty();
+	SocketIds.Empty();
+	SocketNames.Empty();
+	SocketCompatibility.Empty();
+	SocketMatrixWords = 0;
+	GroundTileMask.Empty();
+	EmptyTileMask.Empty();
+	CompatibilityMasks.Empty();
+	InitialSupportCounts.Empty();
+}
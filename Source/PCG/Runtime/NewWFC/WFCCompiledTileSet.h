@@ -0,0 +1,69 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "WFCTypes.h"
+
+class UWFCTileSet;
+
+//求解器使用的瓦片数据，按属性分开存放，热路径上不再访问FString和UObject
+//同内容的瓦片集只编译一次，由FindOrBuild在所有FWFCCore之间共享，编译后只读
+struct PCG_API FWFCCompiledTileSet
+{
+    static TSharedPtr<const FWFCCompiledTileSet> FindOrBuild(const UWFCTileSet& TileSet);
+    static void ClearCache();
+    static uint32 ComputeContentHash(const UWFCTileSet& TileSet);
+
+    uint32 ContentHash = 0;
+    int32 NumTiles = 0;
+    int32 NumMaskWords = 0;
+
+    TArray<float> Weights;
+    TArray<float> WeightLogWeights;
+    TArray<EWFCTileCategory> Categories;
+    TArray<int32> MaxInstances;
+    TArray<bool> RequiresSupport;
+
+    //[Tile * 6 + Dir]，下标对应SocketNames
+    TArray<int32> SocketIds;
+    TArray<FString> SocketNames;
+    //SocketId两两兼容的位矩阵，每行SocketMatrixWords个字
+    TArray<uint64> SocketCompatibility;
+    int32 SocketMatrixWords = 0;
+
+    //按类别的瓦片位掩码，长度为NumMaskWords
+    TArray<uint64> GroundTileMask;
+    TArray<uint64> EmptyTileMask;
+
+    //[Dir][Tile]对应的兼容邻居位掩码，按NumMaskWords个uint64连续存放
+    TArray<uint64> CompatibilityMasks;
+    //AC-4初始支持数，[Tile * 6 + Dir]
+    TArray<int32> InitialSupportCounts;
+
+    void Build(const UWFCTileSet& TileSet);
+    void Empty();
+    SIZE_T GetAllocatedSize() const;
+    bool Matches(const UWFCTileSet& TileSet) const;
+
+    //烘焙用二进制块：定长头后各数组按原始字节连续存放，读取时只做整块拷贝
+    void SaveToBlob(TArray<uint8>& OutBlob) const;
+    bool LoadFromBlob(const TArray<uint8>& Blob);
+
+    const uint64* GetCompatibilityMask(int32 Direction, int32 TileIndex) const
+    {
+        return CompatibilityMasks.GetData() + (Direction * NumTiles + TileIndex) * NumMaskWords;
+    }
+
+    int32 GetSocketId(int32 TileIndex, int32 Direction) const { return SocketIds[TileIndex * 6 + Direction]; }
+    bool IsEmptyTile(int32 TileIndex) const { return Categories[TileIndex] == EWFCTileCategory::Empty; }
+    bool AreSocketsCompatible(int32 SocketA, int32 SocketB) const
+    {
+        return (SocketCompatibility[SocketA * SocketMatrixWords + SocketB / 64] >> (SocketB % 64)) & 1ull;
+    }
+
+private:
+    void BuildSocketTable(const UWFCTileSet& TileSet);
+    void BuildCompatibilityMasks();
+    void ValidateCompatibilityMasks() const;
+};
@@ -3,18 +3,50 @@
 #include "WFCCore.h"
 
 #include "WFCPreProcessCache.h"
+#include "Async/ParallelFor.h"
+#include "ProfilingDebugging/CountersTrace.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+TRACE_DECLARE_INT_COUNTER(WFCPropagations, TEXT("WFC/Propagations"));
+TRACE_DECLARE_INT_COUNTER(WFCBans, TEXT("WFC/Bans"));
+TRACE_DECLARE_INT_COUNTER(WFCQueuePushes, TEXT("WFC/QueuePushes"));
+TRACE_DECLARE_INT_COUNTER(WFCContradictions, TEXT("WFC/Contradictions"));
+TRACE_DECLARE_INT_COUNTER(WFCBacktracks, TEXT("WFC/Backtracks"));
+TRACE_DECLARE_INT_COUNTER(WFCRetries, TEXT("WFC/Retries"));
+
+namespace
+{
+	//首次尝试失败后最多重试的次数
+	constexpr int32 MaxGenerationRetries = 100;
+	constexpr int32 MaxChunkRetries = 10;
 
-const TArray<FIntVector> FWFCCore::DirectionVectors = {
-	FIntVector(0, 0, 1),
-	FIntVector(0, 0, -1),
-	FIntVector(0, 1, 0),
-	FIntVector(0, -1, 0),
-	FIntVector(1, 0, 0),
-	FIntVector(-1, 0, 0)
-};
+	//位置约束使用整体网格坐标，换算到块内并去掉块外的位置；层级约束只与Z有关，块与整体网格一致
+	FWFCGenerationConstraint MakeChunkConstraint(const FWFCGenerationConstraint& Constraint, const FIntVector& RegionMin,
+	                                             const FIntVector& RegionMax)
+	{
+		auto ToChunk = [&RegionMin, &RegionMax](const TArray<FWFCCoordinate>& Positions)
+		{
+			TArray<FWFCCoordinate> Local;
+			for (const FWFCCoordinate& Pos : Positions)
+			{
+				if (Pos.X >= RegionMin.X && Pos.X < RegionMax.X && Pos.Y >= RegionMin.Y && Pos.Y < RegionMax.Y)
+				{
+					Local.Emplace(Pos.X - RegionMin.X, Pos.Y - RegionMin.Y, Pos.Z);
+				}
+			}
+			return Local;
+		};
+
+		FWFCGenerationConstraint ChunkConstraint = Constraint;
+		ChunkConstraint.RequiredPositions = ToChunk(Constraint.RequiredPositions);
+		ChunkConstraint.ForbiddenPositions = ToChunk(Constraint.ForbiddenPositions);
+		return ChunkConstraint;
+	}
+}
 
 FWFCCore::FWFCCore()
 {
+	SelectPropagationKernels();
 }
 
 FWFCCore::~FWFCCore()
@@ -22,6 +54,54 @@ FWFCCore::~FWFCCore()
 	Reset();
 }
 
+void FWFCCore::EnableStatusEvents()
+{
+	if (!StatusEvents)
+	{
+		StatusEventCapacity = 0;
+	}
+	ResizeStatusEvents();
+	DroppedStatusEvents.store(0, std::memory_order_relaxed);
+}
+
+void FWFCCore::ResizeStatusEvents()
+{
+	//回溯会重复坍缩同一格子，按格子数的两倍分配
+	const int64 NumCells = static_cast<int64>(Config.GridSize.X) * Config.GridSize.Y * Config.GridSize.Z;
+	const uint32 NewCapacity = static_cast<uint32>(FMath::Clamp<int64>(NumCells * 2, 64, MAX_int32 / 2));
+	if (StatusEvents && NewCapacity <= StatusEventCapacity)
+	{
+		return;
+	}
+	//重新分配前把已有事件交付出去，TCircularQueue的容量会取整到2的幂并留一个空位
+	DrainStatusEvents();
+	StatusEvents = MakeUnique<TCircularQueue<FWFCStatusEvent>>(NewCapacity + 1);
+	StatusEventCapacity = NewCapacity;
+}
+
+void FWFCCore::PostForwardedStatusEvent(const FWFCCoordinate& Coord, int32 TileIndex)
+{
+	FScopeLock Lock(&StatusForwardLock);
+	PostStatusEvent(Coord, TileIndex);
+}
+
+int32 FWFCCore::DrainStatusEvents(int32 MaxEvents)
+{
+	if (!StatusEvents)
+	{
+		return 0;
+	}
+
+	int32 NumDrained = 0;
+	FWFCStatusEvent Event;
+	while (NumDrained < MaxEvents && StatusEvents->Dequeue(Event))
+	{
+		OnStatusUpdate.ExecuteIfBound(Event.Coord, Event.TileIndex);
+		NumDrained++;
+	}
+	return NumDrained;
+}
+
 bool FWFCCore::Initialize(UWFCTileSet* InTileSet, const FWFCConfiguration& InConfig)
 {
 	if (!InTileSet)
@@ -53,144 +133,205 @@ bool FWFCCore::Initialize(UWFCTileSet* InTileSet, const FWFCConfiguration& InCon
 
 	Reset();
 
+	CompiledTiles = FWFCCompiledTileSet::FindOrBuild(*TileSet);
+	MaskWords = CompiledTiles->NumMaskWords;
+	AllowedScratch.SetNumZeroed(MaskWords);
+	SelectPropagationKernels();
 	InitializeGrid();
-	BuildPropagationRules();
+	if (StatusEvents)
+	{
+		ResizeStatusEvents();
+	}
 	//ApplyConstraints();
 
 	UE_LOG(LogTemp, Log, TEXT("WFCCore: Initialization complete"));
 	return true;
 }
 
+void FWFCCore::InitializeFrom(const FWFCCore& Parent, const FWFCConfiguration& InConfig)
+{
+	TileSet = Parent.TileSet;
+	Config = InConfig;
+	RandomGenerator.Initialize(Config.RandomSeed);
+	PreProcessCache = Parent.PreProcessCache;
+	CompiledTiles = Parent.CompiledTiles;
+	MaskWords = Parent.MaskWords;
+	AllowedScratch.SetNumZeroed(MaskWords);
+	SelectPropagationKernels();
+}
+
+//预处理快照只依赖网格尺寸、约束和缓存，尺寸不变时沿用，网格留到下次生成时从快照恢复
 void FWFCCore::UpdateGrid(const FWFCConfiguration& InConfig)
 {
+	BacktrackBlacklist.Empty();
+	if (Config.GridSize == InConfig.GridSize && PreparedGrid.IsValid())
+	{
+		return;
+	}
+
 	Config.GridSize = InConfig.GridSize;
-	InitializeGrid();
+	PreparedGrid.Reset();
+	Grid.Empty();
+	if (StatusEvents)
+	{
+		ResizeStatusEvents();
+	}
 }
 
 void FWFCCore::InitializeGrid()
 {
-	Grid.Empty();
-	if (!TileSet)
+	TRACE_CPUPROFILER_EVENT_SCOPE(FWFCCore::InitializeGrid);
+	if (!CompiledTiles)
 	{
-		UE_LOG(LogTemp, Error, TEXT("WFCCore: TileSet is null"));
+		Grid.Empty();
+		UE_LOG(LogTemp, Error, TEXT("WFCCore: Compiled tile set is null"));
 		return;
 	}
 
-	const int32 TileCount = TileSet->GetTileCount();
+	//并行尝试与分块的求解器在工作线程上初始化，只读取编译数据
+	const int32 TileCount = CompiledTiles->NumTiles;
 	const int32 TotalCells = Config.GridSize.X * Config.GridSize.Y * Config.GridSize.Z;
 
 	UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Initializing grid with %d cells, %d tile types"),
 	       TotalCells, TileCount);
 
-	for (int32 X = 0; X < Config.GridSize.X; X++)
+	Grid.Init(Config.GridSize, Config.bPeriodicBoundary, TileCount);
+	QueuedCells.Init(false, TotalCells);
+	PropagationQueue.Reset();
+
+	//所有格子初始状态相同，权重和与熵只需计算一次
+	if (TotalCells > 0)
 	{
-		for (int32 Y = 0; Y < Config.GridSize.Y; Y++)
+		RecalculateCellWeights(0);
+		const double InitialSumWeights = Grid[0].SumWeights;
+		const double InitialSumWeightLogWeights = Grid[0].SumWeightLogWeights;
+		const float InitialEntropy = CalculateEntropy(Grid[0]);
+		for (int32 Index = 0; Index < TotalCells; Index++)
 		{
-			for (int32 Z = 0; Z < Config.GridSize.Z; Z++)
-			{
-				FWFCCoordinate Coord(X, Y, Z);
-				FWFCCell& Cell = Grid.Add(Coord, FWFCCell(TileCount));
-
-				Cell.PossibleTiles.SetRange(0, TileCount, true);
-				Cell.Entropy = CalculateEntropy(Cell);
-
-				UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Initialized cell %s with entropy %.3f"),
-				       *Coord.ToString(), Cell.Entropy);
-			}
+			Grid[Index].SumWeights = InitialSumWeights;
+			Grid[Index].SumWeightLogWeights = InitialSumWeightLogWeights;
+			Grid[Index].Entropy = InitialEntropy;
 		}
 	}
 
+	InitializeEntropyNoise();
+	RebuildSelectionHeap();
+	InitializeSupportCounts();
+	BanUnsupportedTiles();
+
 	UE_LOG(LogTemp, Log, TEXT("WFCCore: Grid initialization complete - %d cells created"), Grid.Num());
 }
 
-void FWFCCore::BuildPropagationRules()
+//与原先0.001的熵容差相当的随机扰动，熵相近的格子之间随机选择
+void FWFCCore::InitializeEntropyNoise()
 {
-	const int32 TileCount = TileSet->GetTileCount();
-	PropagationRules.Empty();
-	PropagationRules.SetNum(6);
+	EntropyNoise.SetNumUninitialized(Grid.Num());
+	for (int32 Index = 0; Index < Grid.Num(); Index++)
+	{
+		EntropyNoise[Index] = RandomGenerator.FRand() * 1E-3f;
+	}
+}
 
-	UE_LOG(LogTemp, Log, TEXT("WFCCore: Building propagation rules for %d tiles"), TileCount);
+void FWFCCore::InitializeSupportCounts()
+{
+	BanQueue.Reset();
 
-	for (int32 Dir = 0; Dir < 6; Dir++)
+	const int32 Stride = CompiledTiles ? CompiledTiles->InitialSupportCounts.Num() : 0;
+	if (!IsSupportCountMode() || Stride == 0 || Stride != CompiledTiles->NumTiles * FWFCGrid::NumDirections)
 	{
-		PropagationRules[Dir].SetNum(TileCount);
-		EWFCDirection Direction = static_cast<EWFCDirection>(Dir);
-		EWFCDirection OppositeDirection = static_cast<EWFCDirection>(Dir ^ 1);
-
-		const TCHAR* DirectionNames[] = {
-			TEXT("Up"), TEXT("Down"), TEXT("Right"), TEXT("Left"), TEXT("Front"), TEXT("Back")
-		};
+		SupportCounts.Empty();
+		return;
+	}
 
-		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Processing direction %s (opposite: %s)"),
-		       DirectionNames[Dir], DirectionNames[Dir ^ 1]);
+	//初始时所有格子的所有瓦片都可能，每个格子的计数相同
+	SupportCounts.SetNumUninitialized(Grid.Num() * Stride);
+	for (int32 CellIndex = 0; CellIndex < Grid.Num(); CellIndex++)
+	{
+		FMemory::Memcpy(SupportCounts.GetData() + CellIndex * Stride, CompiledTiles->InitialSupportCounts.GetData(),
+		                Stride * sizeof(int32));
+	}
+}
 
-		int32 TotalRules = 0;
+//某方向初始支持数为0的瓦片，只要该方向有邻居就不可能成立。AC-4的计数从0递减永远不会触发排除，
+//因此初始化时对两种传播方式统一排除并传播一次，结果随预处理快照缓存
+void FWFCCore::BanUnsupportedTiles()
+{
+	const int32 TileCount = Grid.GetTileCount();
+	if (!CompiledTiles || CompiledTiles->InitialSupportCounts.Num() != TileCount * FWFCGrid::NumDirections)
+	{
+		return;
+	}
 
-		for (int32 TileA = 0; TileA < TileCount; TileA++)
+	TArray<TPair<int32, int32>> UnsupportedTiles;
+	for (int32 TileIndex = 0; TileIndex < TileCount; TileIndex++)
+	{
+		for (int32 Dir = 0; Dir < FWFCGrid::NumDirections; Dir++)
 		{
-			FWFCTileDefinition TileDefA = TileSet->GetTile(TileA);
-			FString SocketA = TileDefA.GetSocket(Direction);
-
-			for (int32 TileB = 0; TileB < TileCount; TileB++)
+			if (CompiledTiles->InitialSupportCounts[TileIndex * FWFCGrid::NumDirections + Dir] == 0)
 			{
-				FWFCTileDefinition TileDefB = TileSet->GetTile(TileB);
-				FString SocketB = TileDefB.GetSocket(OppositeDirection);
-
-				if (TileSet->AreSocketsCompatible(SocketA, SocketB))
-				{
-					PropagationRules[Dir][TileA].Add(TileB);
-					TotalRules++;
-
-					UE_LOG(LogTemp, VeryVerbose,
-					       TEXT("WFCCore: Rule %s: Tile %d (%s) -> Tile %d (%s) via sockets '%s' <-> '%s'"),
-					       DirectionNames[Dir], TileA, *TileDefA.TileName, TileB, *TileDefB.TileName, *SocketA,
-					       *SocketB);
-				}
+				UnsupportedTiles.Add({TileIndex, Dir});
 			}
-
-			UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Tile %d has %d compatible neighbors in direction %s"),
-			       TileA, PropagationRules[Dir][TileA].Num(), DirectionNames[Dir]);
 		}
-
-		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Direction %s has %d total compatibility rules"),
-		       DirectionNames[Dir], TotalRules);
+	}
+	if (UnsupportedTiles.Num() == 0)
+	{
+		return;
 	}
 
-	UE_LOG(LogTemp, Log, TEXT("WFCCore: Propagation rules building complete"));
+	for (int32 CellIndex = 0; CellIndex < Grid.Num(); CellIndex++)
+	{
+		for (const TPair<int32, int32>& Unsupported : UnsupportedTiles)
+		{
+			if (Grid.GetNeighborIndex(CellIndex, Unsupported.Value) != INDEX_NONE)
+			{
+				RemoveTileOption(CellIndex, Unsupported.Key, false);
+			}
+		}
+	}
 
-	ValidatePropagationRules();
+	if (!PropagateConstraints())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Tiles without any compatible neighbor leave the grid unsolvable"));
+	}
 }
 
-void FWFCCore::ValidatePropagationRules()
+//格子状态不是初始状态时（如读取Cache后）按邻居实际可能瓦片重新计数
+void FWFCCore::RebuildSupportCounts()
 {
-	UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Validating propagation rules symmetry"));
-
-	bool bFoundAsymmetry = false;
-	const int32 TileCount = TileSet->GetTileCount();
-
-	for (int32 Dir = 0; Dir < 6; Dir++)
+	const int32 TileCount = Grid.GetTileCount();
+	const int32 Stride = TileCount * FWFCGrid::NumDirections;
+	if (!CompiledTiles || CompiledTiles->InitialSupportCounts.Num() != Stride)
 	{
-		int32 OppositeDir = Dir ^ 1;
+		return;
+	}
 
-		for (int32 TileA = 0; TileA < TileCount; TileA++)
+	SupportCounts.SetNumUninitialized(Grid.Num() * Stride);
+	for (int32 CellIndex = 0; CellIndex < Grid.Num(); CellIndex++)
+	{
+		int32* CellCounts = SupportCounts.GetData() + CellIndex * Stride;
+		for (int32 Dir = 0; Dir < FWFCGrid::NumDirections; Dir++)
 		{
-			for (int32 TileB : PropagationRules[Dir][TileA])
+			const int32 NeighborIndex = Grid.GetNeighborIndex(CellIndex, Dir);
+			const uint64* NeighborWords = NeighborIndex != INDEX_NONE ? Grid.GetTileWords(NeighborIndex) : nullptr;
+
+			for (int32 Tile = 0; Tile < TileCount; Tile++)
 			{
-				if (!PropagationRules[OppositeDir][TileB].Contains(TileA))
+				if (!NeighborWords)
+				{
+					CellCounts[Tile * FWFCGrid::NumDirections + Dir] = CompiledTiles->InitialSupportCounts[Tile * FWFCGrid::NumDirections + Dir];
+					continue;
+				}
+
+				int32 Count = 0;
+				const uint64* Mask = GetCompatibilityMask(Dir, Tile);
+				for (int32 Word = 0; Word < MaskWords; Word++)
 				{
-					UE_LOG(LogTemp, Warning,
-					       TEXT("WFCCore: Asymmetric rule found - Tile %d -> %d in dir %d, but not reverse"),
-					       TileA, TileB, Dir);
-					bFoundAsymmetry = true;
+					Count += FMath::CountBits(Mask[Word] & NeighborWords[Word]);
 				}
+				CellCounts[Tile * FWFCGrid::NumDirections + Dir] = Count;
 			}
 		}
 	}
-
-	if (!bFoundAsymmetry)
-	{
-		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Propagation rules symmetry validation passed"));
-	}
 }
 
 void FWFCCore::ApplyConstraints()
@@ -219,11 +360,11 @@ void FWFCCore::ApplyConstraints()
 
 		for (const FWFCCoordinate& Pos : Constraint.ForbiddenPositions)
 		{
-			if (FWFCCell* Cell = GetCell(Pos))
+			if (GetCell(Pos))
 			{
 				for (int32 ForbiddenTile : Constraint.ForbiddenTileIndices)
 				{
-					if (ForbiddenTile >= 0 && ForbiddenTile < Cell->PossibleTiles.Num())
+					if (ForbiddenTile >= 0 && ForbiddenTile < Grid.GetTileCount())
 					{
 						RemoveTileOption(Pos, ForbiddenTile, false);
 						UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Removed tile %d from position %s (forbidden)"),
@@ -241,8 +382,9 @@ void FWFCCore::ApplyConstraints()
 		if (Constraint.MinLayer >= 0 || Constraint.MaxLayer >= 0)
 		{
 			int32 AffectedCells = 0;
-			for (auto& [Coord, Cell] : Grid)
+			for (int32 CellIndex = 0; CellIndex < Grid.Num(); CellIndex++)
 			{
+				const FWFCCoordinate Coord = Grid.GetCoordinate(CellIndex);
 				bool bInRange = true;
 				if (Constraint.MinLayer >= 0 && Coord.Z < Constraint.MinLayer)
 				{
@@ -257,9 +399,9 @@ void FWFCCore::ApplyConstraints()
 				{
 					for (int32 ForbiddenTile : Constraint.ForbiddenTileIndices)
 					{
-						if (ForbiddenTile >= 0 && ForbiddenTile < Cell.PossibleTiles.Num())
+						if (ForbiddenTile >= 0 && ForbiddenTile < Grid.GetTileCount())
 						{
-							RemoveTileOption(Coord, ForbiddenTile, false);
+							RemoveTileOption(CellIndex, ForbiddenTile, false);
 							AffectedCells++;
 						}
 					}
@@ -270,7 +412,7 @@ void FWFCCore::ApplyConstraints()
 		}
 	}
 
-	if (!PropagationQueue.IsEmpty())
+	if (PropagationQueue.Num() > 0 || BanQueue.Num() > 0)
 	{
 		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Running initial constraint propagation"));
 		PropagateConstraints();
@@ -281,6 +423,7 @@ void FWFCCore::ApplyConstraints()
 
 void FWFCCore::CellPreProcess()
 {
+	TRACE_CPUPROFILER_EVENT_SCOPE(FWFCCore::CellPreProcess);
 	if (LoadPreProcessedGrid())
 	{
 		UE_LOG(LogTemp, Log, TEXT("WFCCore: Applied cached preprocess data for grid size %s"), 
@@ -288,94 +431,550 @@ void FWFCCore::CellPreProcess()
 		return;
 	}
 
-	UE_LOG(LogTemp, Warning, TEXT("WFCCore: No cache found, generating preprocess data for grid size %s"), 
-		   *Config.GridSize.ToString());
-	
-	for (const auto& [Coord, Cell] : Grid)
+	TArray<int32> BoundaryCells;
+	for (int32 CellIndex = 0; CellIndex < Grid.Num(); CellIndex++)
 	{
-		if (IsBoundaryCoordinate(Coord))
+		if (IsBoundaryCoordinate(Grid.GetCoordinate(CellIndex)))
 		{
-			CollapseCellTo(Coord, 0);
-			PropagateConstraints();
+			BoundaryCells.Add(CellIndex);
 		}
 	}
+	CollapseBoundaryCells(BoundaryCells);
 }
 
+//边界全部填入empty方块后只做一次传播，结果与逐个坍缩再传播相同
+bool FWFCCore::CollapseBoundaryCells(const TArray<int32>& BoundaryCells)
+{
+	for (const int32 CellIndex : BoundaryCells)
+	{
+		if (!Grid[CellIndex].IsCollapsed())
+		{
+			CollapseCellTo(CellIndex, 0);
+		}
+	}
+	return PropagateConstraints();
+}
 
 FWFCGenerationResult FWFCCore::Generate()
 {
+	TRACE_CPUPROFILER_EVENT_SCOPE(FWFCCore::Generate);
+	Stats = FWFCSolverStats();
+
+	//同一求解器的多次生成沿用随机流，因此记录的是当前状态而不是配置中的种子
+	const int32 GenerationSeed = RandomGenerator.GetCurrentSeed();
+	if (bRecordReplay)
+	{
+		BeginReplayLog(GenerationSeed);
+	}
+
 	FWFCGenerationResult Result;
-	double StartTime = FPlatformTime::Seconds();
+	if (Config.ChunkSize > 0 && !Config.bPeriodicBoundary &&
+		(Config.GridSize.X > Config.ChunkSize || Config.GridSize.Y > Config.ChunkSize) && CanGenerateChunked())
+	{
+		Result = GenerateChunked();
+	}
+	else if (Config.ParallelAttempts > 1)
+	{
+		Result = GenerateParallel(GenerationSeed);
+	}
+	else
+	{
+		const double StartTime = FPlatformTime::Seconds();
+
+		bool bSuccess = RunAttempt(GenerationSeed);
+		int count = 0;
+		while (!bSuccess)
+		{
+			if (count >= MaxGenerationRetries || IsCancelled())
+			{break;}
+			count++;
+			bSuccess = RunAttempt(GetAttemptSeed(GenerationSeed, count));
+		}
+		Stats.Retries = count;
+
+		Result = MakeResult(bSuccess, StartTime);
+	}
+
+	if (bRecordReplay)
+	{
+		ReplayLog.ResultHash = ComputeResultHash();
+		ReplayLog.bSuccess = Result.bSuccess;
+	}
+	return Result;
+}
+
+int32 FWFCCore::GetAttemptSeed(int32 GenerationSeed, int32 AttemptIndex)
+{
+	return AttemptIndex == 0
+		       ? GenerationSeed
+		       : static_cast<int32>(HashCombine(GetTypeHash(GenerationSeed), GetTypeHash(AttemptIndex)));
+}
+
+void FWFCCore::BeginReplayLog(int32 GenerationSeed)
+{
+	ReplayLog.Reset();
+	ReplayLog.Config = Config;
+	ReplayLog.TileSetPath = TileSet->GetPathName();
+	ReplayLog.TileSetHash = CompiledTiles->ContentHash;
+	ReplayLog.NumTiles = CompiledTiles->NumTiles;
+	ReplayLog.GenerationSeed = GenerationSeed;
+	for (const auto& [Coord, Tiles] : BacktrackBlacklist)
+	{
+		const int32 CellIndex = Grid.GetIndex(Coord);
+		for (const int32 TileIndex : Tiles)
+		{
+			ReplayLog.LearnedBans.Add({CellIndex, TileIndex});
+		}
+	}
+}
+
+uint32 FWFCCore::ComputeResultHash() const
+{
+	uint32 Hash = GetTypeHash(Grid.Num());
+	for (int32 CellIndex = 0; CellIndex < Grid.Num(); CellIndex++)
+	{
+		const FWFCCell& Cell = Grid[CellIndex];
+		Hash = HashCombineFast(Hash, GetTypeHash(Cell.IsCollapsed() ? Cell.CollapsedTileIndex : INDEX_NONE));
+	}
+	return Hash;
+}
+
+bool FWFCCore::ReplayGeneration(UWFCTileSet* InTileSet, const FWFCReplayLog& Log, FWFCGenerationResult& OutResult)
+{
+	if (!Initialize(InTileSet, Log.Config))
+	{
+		return false;
+	}
+
+	if (CompiledTiles->ContentHash != Log.TileSetHash || CompiledTiles->NumTiles != Log.NumTiles)
+	{
+		UE_LOG(LogTemp, Error, TEXT("WFCCore: Replay tile set %s does not match the recorded %s (%d tiles)"),
+		       *InTileSet->GetPathName(), *Log.TileSetPath, Log.NumTiles);
+		return false;
+	}
+
+	for (const FWFCReplayBan& Ban : Log.LearnedBans)
+	{
+		if (!Grid.IsValidIndex(Ban.CellIndex))
+		{
+			UE_LOG(LogTemp, Error, TEXT("WFCCore: Replay learned ban on invalid cell %d"), Ban.CellIndex);
+			return false;
+		}
+		BlacklistTile(Grid.GetCoordinate(Ban.CellIndex), Ban.TileIndex);
+	}
+
+	RandomGenerator.Initialize(Log.GenerationSeed);
+	const bool bWasRecording = bRecordReplay;
+	bRecordReplay = true;
+	OutResult = Generate();
+	bRecordReplay = bWasRecording;
+
+	const int32 Divergence = ReplayLog.FindFirstDivergence(Log);
+	if (Divergence != INDEX_NONE)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Replay diverged at decision %d of %d"), Divergence,
+		       Log.Decisions.Num());
+		return false;
+	}
+	if (ReplayLog.ResultHash != Log.ResultHash)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Replay result hash %08x does not match recorded %08x"),
+		       ReplayLog.ResultHash, Log.ResultHash);
+		return false;
+	}
+	return true;
+}
+
+bool FWFCCore::RunAttempt(int32 AttemptSeed)
+{
+	Trail.Reset();
+	Checkpoints.Reset();
+	BacktrackCount = 0;
+	//每次尝试都从预处理快照和自己的种子开始，与之前的尝试消耗了多少随机数无关
+	if (!PreparedGrid.IsValid())
+	{
+		PrepareGrid();
+	}
+	RandomGenerator.Initialize(AttemptSeed);
+	RestorePreparedGrid();
 
+	if (bRecordReplay)
+	{
+		ReplayLog.Attempts.Add({AttemptSeed, ReplayLog.Decisions.Num()});
+	}
+
+	if (BacktrackBlacklist.Num() > 0 && !ApplyLearnedNogoods())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Learned nogoods leave no valid tiles, grid is unsolvable"));
+		return false;
+	}
+
+	return RunGenerationLoop();
+}
+
+//预处理结果只与网格尺寸、约束和缓存有关，与种子无关，之后的尝试直接从快照开始
+void FWFCCore::PrepareGrid()
+{
 	TileInstanceCounts.Empty();
-	ChangeHistory.Empty();
 	CollapseHistory.Empty();
 	InitializeGrid();
+	ClearPropagationQueue();
+
+	CellPreProcess();
 
-	while (!PropagationQueue.IsEmpty())
+	TSharedRef<FWFCPreparedGrid> Prepared = MakeShared<FWFCPreparedGrid>();
+	Prepared->Grid = Grid;
+	Prepared->SupportCounts = SupportCounts;
+	Prepared->CollapseHistory = CollapseHistory;
+	Prepared->TileInstanceCounts = TileInstanceCounts;
+	PreparedGrid = Prepared;
+}
+
+//格子与位集都是定长连续块，恢复时整块拷贝，不重新分配
+void FWFCCore::RestorePreparedGrid()
+{
+	Grid.CopyStateFrom(PreparedGrid->Grid);
+	SupportCounts.SetNumUninitialized(PreparedGrid->SupportCounts.Num());
+	FMemory::Memcpy(SupportCounts.GetData(), PreparedGrid->SupportCounts.GetData(),
+	                PreparedGrid->SupportCounts.Num() * sizeof(int32));
+	CollapseHistory = PreparedGrid->CollapseHistory;
+	TileInstanceCounts = PreparedGrid->TileInstanceCounts;
+	QueuedCells.Init(false, Grid.Num());
+	PropagationQueue.Reset();
+	BanQueue.Reset();
+
+	InitializeEntropyNoise();
+	RebuildSelectionHeap();
+}
+
+bool FWFCCore::RunAttemptWithFixedCells(const TArray<TPair<int32, int32>>& SeamCells, const TArray<int32>& BoundaryCells)
+{
+	TileInstanceCounts.Empty();
+	Trail.Reset();
+	Checkpoints.Reset();
+	BacktrackCount = 0;
+	CollapseHistory.Empty();
+	InitializeGrid();
+	ClearPropagationQueue();
+
+	//接缝格子必须与相邻块的结果一致
+	for (const TPair<int32, int32>& Seam : SeamCells)
 	{
-		FWFCCoordinate Dummy;
-		PropagationQueue.Dequeue(Dummy);
+		const FWFCCell& Cell = Grid[Seam.Key];
+		if (Cell.IsCollapsed() ? Cell.CollapsedTileIndex != Seam.Value : !CollapseCellTo(Seam.Key, Seam.Value))
+		{
+			return false;
+		}
 	}
 
-	CellPreProcess();
+	if (!CollapseBoundaryCells(BoundaryCells))
+	{
+		return false;
+	}
 
-	Result.bSuccess = RunGenerationLoop();
-	int count = 0;
-	while (!Result.bSuccess)
+	if (BacktrackBlacklist.Num() > 0 && !ApplyLearnedNogoods())
 	{
-		if (count >= 100)
-		{break;}
-		TileInstanceCounts.Empty();
-		ChangeHistory.Empty();
-		CollapseHistory.Empty();
-		InitializeGrid();
+		return false;
+	}
 
-		while (!PropagationQueue.IsEmpty())
-		{
-			FWFCCoordinate Dummy;
-			PropagationQueue.Dequeue(Dummy);
-		}
+	return RunGenerationLoop();
+}
 
-		CellPreProcess();
-		Result.bSuccess = RunGenerationLoop();
-		count++;
+//块只统计自身的瓦片数量，按整体网格计数的数量上下限无法分块保证
+bool FWFCCore::CanGenerateChunked() const
+{
+	const bool bConstraintCounts = Config.Constraints.ContainsByPredicate([](const FWFCGenerationConstraint& Constraint)
+	{
+		return Constraint.MinInstances > 0 || Constraint.MaxInstances >= 0;
+	});
+	const bool bTileLimits = CompiledTiles && CompiledTiles->MaxInstances.ContainsByPredicate([](int32 MaxInstances)
+	{
+		return MaxInstances > 0;
+	});
+	if (bConstraintCounts || bTileLimits)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Instance limits are counted over the whole grid, ignoring ChunkSize %d"),
+		       Config.ChunkSize);
+		return false;
 	}
-	if (Result.bSuccess)
+	return true;
+}
+
+FWFCGenerationResult FWFCCore::GenerateChunked()
+{
+	const double StartTime = FPlatformTime::Seconds();
+	const FIntVector Size = Config.GridSize;
+	const int32 ChunkSize = Config.ChunkSize;
+	//扩展不超过一块，保证同一阶段的块读写的格子互不重叠
+	const int32 Overlap = FMath::Clamp(Config.ChunkOverlap, 1, ChunkSize);
+	const int32 ChunksX = FMath::DivideAndRoundUp(Size.X, ChunkSize);
+	const int32 ChunksY = FMath::DivideAndRoundUp(Size.Y, ChunkSize);
+
+	Grid.Init(Size, false, CompiledTiles->NumTiles);
+	TArray<int32> SolvedTiles;
+	SolvedTiles.Init(INDEX_NONE, Grid.Num());
+	TArray<TArray<FWFCCoordinate>> ChunkHistories;
+	ChunkHistories.SetNum(ChunksX * ChunksY);
+	TArray<FWFCSolverStats> ChunkStats;
+	ChunkStats.SetNum(ChunksX * ChunksY);
+	CollapseHistory.Empty();
+	Trail.Reset();
+	Checkpoints.Reset();
+	BacktrackCount = 0;
+	std::atomic<int32> FailedChunks(0);
+
+	UE_LOG(LogTemp, Log, TEXT("WFCCore: Chunked generation of %s with %dx%d chunks of size %d, overlap %d"),
+	       *Size.ToString(), ChunksX, ChunksY, ChunkSize, Overlap);
+
+	//四个阶段按块坐标奇偶划分，同一阶段的块互不相邻
+	for (int32 Phase = 0; Phase < 4; Phase++)
 	{
-		for (const auto& [Coord, Cell] : Grid)
+		TArray<int32> PhaseChunks;
+		for (int32 ChunkY = Phase >> 1; ChunkY < ChunksY; ChunkY += 2)
 		{
-			if (Cell.IsCollapsed())
+			for (int32 ChunkX = Phase & 1; ChunkX < ChunksX; ChunkX += 2)
 			{
-				Result.TileAssignments.Add(Coord, Cell.CollapsedTileIndex);
+				PhaseChunks.Add(ChunkY * ChunksX + ChunkX);
 			}
-			else
+		}
+
+		ParallelFor(PhaseChunks.Num(), [&](int32 Slot)
+		{
+			const int32 ChunkIndex = PhaseChunks[Slot];
+			const FIntVector CoreMin((ChunkIndex % ChunksX) * ChunkSize, (ChunkIndex / ChunksX) * ChunkSize, 0);
+			const FIntVector CoreMax(FMath::Min(CoreMin.X + ChunkSize, Size.X), FMath::Min(CoreMin.Y + ChunkSize, Size.Y), Size.Z);
+			const FIntVector RegionMin(FMath::Max(CoreMin.X - Overlap, 0), FMath::Max(CoreMin.Y - Overlap, 0), 0);
+			const FIntVector RegionMax(FMath::Min(CoreMax.X + Overlap, Size.X), FMath::Min(CoreMax.Y + Overlap, Size.Y), Size.Z);
+
+			FWFCConfiguration ChunkConfig = Config;
+			ChunkConfig.GridSize = RegionMax - RegionMin;
+			ChunkConfig.ChunkSize = 0;
+			ChunkConfig.ParallelAttempts = 1;
+			ChunkConfig.RandomSeed = static_cast<int32>(HashCombine(GetTypeHash(Config.RandomSeed), GetTypeHash(ChunkIndex)));
+			ChunkConfig.Constraints.Reset();
+			for (const FWFCGenerationConstraint& Constraint : Config.Constraints)
+			{
+				ChunkConfig.Constraints.Add(MakeChunkConstraint(Constraint, RegionMin, RegionMax));
+			}
+
+			FWFCCore ChunkCore;
+			ChunkCore.InitializeFrom(*this, ChunkConfig);
+			ChunkCore.InitializeGrid();
+			ChunkCore.SetCancellationCheck(CancellationCheck);
+
+			//扩展区内前面阶段已求解的格子固定为接缝，整体网格的边界按CellPreProcess的方式填充
+			TArray<TPair<int32, int32>> SeamCells;
+			TArray<int32> BoundaryCells;
+			for (int32 LocalIndex = 0; LocalIndex < ChunkCore.Grid.Num(); LocalIndex++)
+			{
+				const FWFCCoordinate Local = ChunkCore.Grid.GetCoordinate(LocalIndex);
+				const FWFCCoordinate World(Local.X + RegionMin.X, Local.Y + RegionMin.Y, Local.Z);
+				const int32 SolvedTile = SolvedTiles[Grid.GetIndex(World)];
+				if (SolvedTile != INDEX_NONE)
+				{
+					SeamCells.Emplace(LocalIndex, SolvedTile);
+				}
+				else if (IsBoundaryCoordinate(World))
+				{
+					BoundaryCells.Add(LocalIndex);
+				}
+			}
+
+			bool bSolved = false;
+			int32 Attempt = 0;
+			for (; Attempt <= MaxChunkRetries && !bSolved; Attempt++)
+			{
+				bSolved = ChunkCore.RunAttemptWithFixedCells(SeamCells, BoundaryCells);
+			}
+			ChunkStats[ChunkIndex] = ChunkCore.Stats;
+			ChunkStats[ChunkIndex].Retries = Attempt - 1;
+			if (!bSolved)
 			{
-				Result.FailedPositions.Add(Coord);
+				UE_LOG(LogTemp, Warning, TEXT("WFCCore: Chunk %d failed after %d attempts"), ChunkIndex, MaxChunkRetries + 1);
+				FailedChunks++;
+				return;
 			}
+
+			//只写回块自身范围，扩展区的结果丢弃
+			TArray<FWFCCoordinate>& History = ChunkHistories[ChunkIndex];
+			for (const FWFCCoordinate& Local : ChunkCore.CollapseHistory)
+			{
+				const FWFCCoordinate World(Local.X + RegionMin.X, Local.Y + RegionMin.Y, Local.Z);
+				if (World.X < CoreMin.X || World.X >= CoreMax.X || World.Y < CoreMin.Y || World.Y >= CoreMax.Y)
+				{
+					continue;
+				}
+				int32& SolvedTile = SolvedTiles[Grid.GetIndex(World)];
+				if (SolvedTile == INDEX_NONE)
+				{
+					SolvedTile = ChunkCore.Grid[ChunkCore.Grid.GetIndex(Local)].CollapsedTileIndex;
+					History.Add(World);
+					//扩展区和失败重试的坍缩不转发，只报告写回整体网格的结果
+					if (StatusEvents)
+					{
+						PostForwardedStatusEvent(World, SolvedTile);
+					}
+				}
+			}
+		}, EParallelForFlags::Unbalanced);
+
+		for (const int32 ChunkIndex : PhaseChunks)
+		{
+			CollapseHistory.Append(ChunkHistories[ChunkIndex]);
+			Stats.Accumulate(ChunkStats[ChunkIndex]);
 		}
+	}
 
-		UE_LOG(LogTemp, Log, TEXT("WFCCore: Generation succeeded with %d placed tiles, %d failed positions"),
-		       Result.TileAssignments.Num(), Result.FailedPositions.Num());
+	TileInstanceCounts.Empty();
+	for (int32 CellIndex = 0; CellIndex < Grid.Num(); CellIndex++)
+	{
+		const int32 SolvedTile = SolvedTiles[CellIndex];
+		if (SolvedTile == INDEX_NONE)
+		{
+			continue;
+		}
+		FWFCCell& Cell = Grid[CellIndex];
+		Cell.bCollapsed = true;
+		Cell.CollapsedTileIndex = SolvedTile;
+		Grid.SetSinglePossibleTile(CellIndex, SolvedTile);
+		TileInstanceCounts.FindOrAdd(SolvedTile, 0)++;
 	}
-	else
+
+	return MakeResult(FailedChunks.load() == 0, StartTime);
+}
+
+FWFCGenerationResult FWFCCore::GenerateParallel(int32 GenerationSeed)
+{
+	const double StartTime = FPlatformTime::Seconds();
+	const int32 BatchSize = Config.ParallelAttempts;
+	const int32 TotalAttempts = MaxGenerationRetries + 1;
+
+	//每个尝试使用独立的求解器；编号大于当前最优成功编号的尝试会被取消，
+	//编号更小的尝试总会跑完，因此同一种子的结果与线程调度无关
+	std::atomic<int32> BestAttempt(MAX_int32);
+	TArray<TUniquePtr<FWFCCore>> Attempts;
+	Attempts.SetNum(BatchSize);
+	if (!PreparedGrid.IsValid())
 	{
-		Result.ErrorMessage = TEXT("Generation failed - contradiction detected or max iterations reached");
-		UE_LOG(LogTemp, Warning, TEXT("WFCCore: %s"), *Result.ErrorMessage);
+		PrepareGrid();
+	}
 
-		for (const auto& [Coord, Cell] : Grid)
+	for (int32 BatchStart = 0; BatchStart < TotalAttempts && BestAttempt.load() == MAX_int32; BatchStart += BatchSize)
+	{
+		const int32 BatchCount = FMath::Min(BatchSize, TotalAttempts - BatchStart);
+		//尝试求解器在调用线程上构造，复用已编译的瓦片数据和预处理快照，工作线程不访问UObject
+		for (int32 Slot = 0; Slot < BatchCount; Slot++)
 		{
-			if (Cell.IsCollapsed())
+			const int32 AttemptIndex = BatchStart + Slot;
+			FWFCConfiguration AttemptConfig = Config;
+			AttemptConfig.ParallelAttempts = 1;
+			AttemptConfig.RandomSeed = GetAttemptSeed(GenerationSeed, AttemptIndex);
+
+			TUniquePtr<FWFCCore>& Attempt = Attempts[Slot];
+			Attempt = MakeUnique<FWFCCore>();
+			Attempt->InitializeFrom(*this, AttemptConfig);
+			Attempt->PreparedGrid = PreparedGrid;
+			Attempt->BacktrackBlacklist = BacktrackBlacklist;
+			Attempt->bRecordReplay = bRecordReplay;
+			Attempt->StatusEventTarget = StatusEvents ? this : nullptr;
+			Attempt->SetCancellationCheck([&BestAttempt, AttemptIndex]()
 			{
-				Result.TileAssignments.Add(Coord, Cell.CollapsedTileIndex);
+				return BestAttempt.load(std::memory_order_relaxed) < AttemptIndex;
+			});
+		}
+
+		ParallelFor(BatchCount, [&](int32 Slot)
+		{
+			const int32 AttemptIndex = BatchStart + Slot;
+			FWFCCore& Attempt = *Attempts[Slot];
+			if (Attempt.RunAttempt(Attempt.Config.RandomSeed))
+			{
+				int32 Current = BestAttempt.load();
+				while (AttemptIndex < Current && !BestAttempt.compare_exchange_weak(Current, AttemptIndex))
+				{
+				}
 			}
-			else
+		}, EParallelForFlags::Unbalanced);
+
+		//编号不大于最优成功编号的尝试都完整运行，只合并它们学到的禁用，结果与线程调度无关
+		const int32 LastCompleted = BestAttempt.load();
+		for (int32 Slot = 0; Slot < BatchCount; Slot++)
+		{
+			const FWFCCore& Attempt = *Attempts[Slot];
+			Stats.Accumulate(Attempt.Stats);
+			if (BatchStart + Slot > LastCompleted)
 			{
-				Result.FailedPositions.Add(Coord);
+				continue;
 			}
+			for (const auto& [Coord, Tiles] : Attempt.BacktrackBlacklist)
+			{
+				for (const int32 TileIndex : Tiles)
+				{
+					BlacklistTile(Coord, TileIndex);
+				}
+			}
+		}
+		Stats.Retries += BatchCount;
+	}
+	Stats.Retries = FMath::Max(Stats.Retries - 1, 0);
+
+	const int32 Best = BestAttempt.load();
+	const bool bSuccess = Best != MAX_int32;
+	//成功时取最优尝试的状态，否则保留最后一个尝试的状态用于报告失败位置
+	const int32 ResultSlot = bSuccess ? Best % BatchSize : (TotalAttempts - 1) % BatchSize;
+	if (FWFCCore* Winner = Attempts[ResultSlot].Get())
+	{
+		Grid = MoveTemp(Winner->Grid);
+		CollapseHistory = MoveTemp(Winner->CollapseHistory);
+		TileInstanceCounts = MoveTemp(Winner->TileInstanceCounts);
+		if (bRecordReplay)
+		{
+			ReplayLog.Attempts = MoveTemp(Winner->ReplayLog.Attempts);
+			ReplayLog.Decisions = MoveTemp(Winner->ReplayLog.Decisions);
 		}
 	}
 
+	UE_LOG(LogTemp, Log, TEXT("WFCCore: Parallel generation picked attempt %d (batch size %d)"),
+	       bSuccess ? Best : INDEX_NONE, BatchSize);
+	return MakeResult(bSuccess, StartTime);
+}
+
+FWFCGenerationResult FWFCCore::MakeResult(bool bSuccess, double StartTime) const
+{
+	FWFCGenerationResult Result;
+	Result.bSuccess = bSuccess;
+	Result.Stats = Stats;
+
+	//计数器只在每次生成结束时提交一次，热路径上只有普通自增
+	TRACE_COUNTER_ADD(WFCPropagations, Stats.Propagations);
+	TRACE_COUNTER_ADD(WFCBans, Stats.Bans);
+	TRACE_COUNTER_ADD(WFCQueuePushes, Stats.QueuePushes);
+	TRACE_COUNTER_ADD(WFCContradictions, Stats.Contradictions);
+	TRACE_COUNTER_ADD(WFCBacktracks, Stats.Backtracks);
+	TRACE_COUNTER_ADD(WFCRetries, Stats.Retries);
+
+	TSharedRef<FWFCTileAssignments> Assignments = MakeShared<FWFCTileAssignments>();
+	Assignments->GridSize = Grid.GetSize();
+	Assignments->TileIndices.SetNumUninitialized(Grid.Num());
+	for (int32 CellIndex = 0; CellIndex < Grid.Num(); CellIndex++)
+	{
+		const FWFCCell& Cell = Grid[CellIndex];
+		Assignments->TileIndices[CellIndex] = Cell.IsCollapsed() ? Cell.CollapsedTileIndex : INDEX_NONE;
+		Assignments->NumPlaced += Cell.IsCollapsed() ? 1 : 0;
+	}
+	Result.TileAssignments = Assignments;
+
+	if (Result.bSuccess)
+	{
+		UE_LOG(LogTemp, Log, TEXT("WFCCore: Generation succeeded with %d placed tiles, %d failed positions"),
+		       Result.GetPlacedTileCount(), Result.GetFailedPositionCount());
+	}
+	else
+	{
+		Result.ErrorMessage = TEXT("Generation failed - contradiction detected or max iterations reached");
+		UE_LOG(LogTemp, Warning, TEXT("WFCCore: %s"), *Result.ErrorMessage);
+	}
+
 	Result.GenerationTimeSeconds = FPlatformTime::Seconds() - StartTime;
 	Result.IterationsUsed = CollapseHistory.Num();
 
@@ -391,9 +990,15 @@ bool FWFCCore::RunGenerationLoop()
 
 	for (int32 Iteration = 0; Iteration < Config.MaxIterations; Iteration++)
 	{
-		FWFCCoordinate NextCoord = SelectNextCell();
+		if (IsCancelled())
+		{
+			UE_LOG(LogTemp, Verbose, TEXT("WFCCore: Generation cancelled at iteration %d"), Iteration);
+			return false;
+		}
 
-		if (NextCoord == FWFCCoordinate(-1, -1, -1))
+		const int32 NextCell = SelectNextCell();
+
+		if (NextCell == INDEX_NONE)
 		{
 			UE_LOG(LogTemp, Log, TEXT("WFCCore: Generation completed at iteration %d - no more cells to collapse"),
 			       Iteration);
@@ -401,16 +1006,24 @@ bool FWFCCore::RunGenerationLoop()
 		}
 
 		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Iteration %d - selected cell %s"), Iteration,
-		       *NextCoord.ToString());
+		       *Grid.GetCoordinate(NextCell).ToString());
 
 		if (Config.bEnableBacktracking)
 		{
-			SaveState();
+			SaveState(NextCell);
+		}
+
+		const bool bCollapsed = CollapseCell(NextCell);
+		if (bCollapsed && Checkpoints.Num() > 0)
+		{
+			Checkpoints.Last().TileIndex = Grid[NextCell].CollapsedTileIndex;
 		}
 
-		if (!CollapseCell(NextCoord))
+		if (!bCollapsed)
 		{
-			UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Collapse failed for cell %s"), *NextCoord.ToString());
+			Stats.Contradictions++;
+			UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Collapse failed for cell %s"),
+			       *Grid.GetCoordinate(NextCell).ToString());
 
 			if (Config.bEnableBacktracking && CanBacktrack())
 			{
@@ -427,8 +1040,9 @@ bool FWFCCore::RunGenerationLoop()
 
 		if (!PropagateConstraints())
 		{
+			Stats.Contradictions++;
 			UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Propagation failed after collapsing cell %s"),
-			       *NextCoord.ToString());
+			       *Grid.GetCoordinate(NextCell).ToString());
 
 			if (Config.bEnableBacktracking && CanBacktrack())
 			{
@@ -455,242 +1069,120 @@ bool FWFCCore::RunGenerationLoop()
 	return false;
 }
 
-FWFCCoordinate FWFCCore::SelectNextCell()
-{
-	switch (Config.GenerationMode)
-	{
-	case EWFCGenerationMode::GroundFirst:
-		return SelectCellGroundFirst();
-	case EWFCGenerationMode::LayeredBottomUp:
-		return SelectCellLayered();
-	case EWFCGenerationMode::CenterOutward:
-		return SelectCellCenterOut();
-	default:
-		return SelectCellRandom();
-	}
-}
-
-FWFCCoordinate FWFCCore::SelectCellRandom()
+int32 FWFCCore::SelectNextCell()
 {
-	float MinEntropy = FLT_MAX;
-	TArray<FWFCCoordinate> Candidates;
-
-	for (const auto& [Coord, Cell] : Grid)
+	TRACE_CPUPROFILER_EVENT_SCOPE(FWFCCore::SelectNextCell);
+	const int32 CellIndex = SelectionHeap.Top();
+	if (CellIndex != INDEX_NONE)
 	{
-		if (!Cell.IsCollapsed() && Cell.GetPossibleTileCount() > 0)
-		{
-			if (Cell.Entropy < MinEntropy)
-			{
-				MinEntropy = Cell.Entropy;
-				Candidates.Empty();
-				Candidates.Add(Coord);
-			}
-			else if (FMath::IsNearlyEqual(Cell.Entropy, MinEntropy, 0.001f))
-			{
-				Candidates.Add(Coord);
-			}
-		}
+		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Selected %s with entropy %.3f from %d candidates"),
+		       *Grid.GetCoordinate(CellIndex).ToString(), Grid[CellIndex].Entropy, SelectionHeap.Num());
 	}
-
-	if (Candidates.Num() > 0)
-	{
-		int32 SelectedIndex = RandomGenerator.RandRange(0, Candidates.Num() - 1);
-		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Random selection - %d candidates with entropy %.3f, selected %s"),
-		       Candidates.Num(), MinEntropy, *Candidates[SelectedIndex].ToString());
-		return Candidates[SelectedIndex];
-	}
-
-	return FWFCCoordinate(-1, -1, -1);
+	return CellIndex;
 }
 
-FWFCCoordinate FWFCCore::SelectCellGroundFirst()
+FWFCEntropyHeap::FKey FWFCCore::GetSelectionKey(int32 CellIndex) const
 {
-	TArray<int32> GroundTiles = TileSet->GetTilesByCategory(EWFCTileCategory::Ground);
+	const FWFCCell& Cell = Grid[CellIndex];
+	FWFCEntropyHeap::FKey Key;
+	Key.Entropy = Cell.Entropy + EntropyNoise[CellIndex];
 
-	float MinEntropy = FLT_MAX;
-	bool FoundGroundCandidate = false;
-	TArray<FWFCCoordinate> GroundCandidates;
-	TArray<FWFCCoordinate> OtherCandidates;
-
-	for (const auto& [Coord, Cell] : Grid)
+	switch (Config.GenerationMode)
 	{
-		if (Cell.IsCollapsed() || Cell.GetPossibleTileCount() == 0) continue;
-
-		bool CanPlaceGround = false;
-		for (int32 GroundTile : GroundTiles)
-		{
-			if (GroundTile < Cell.PossibleTiles.Num() && Cell.CanPlace(GroundTile))
-			{
-				CanPlaceGround = true;
-				break;
-			}
-		}
-
-		if (CanPlaceGround)
+	case EWFCGenerationMode::GroundFirst:
 		{
-			if (Cell.Entropy < MinEntropy || !FoundGroundCandidate)
+			//可以放置地面瓦片的格子优先
+			bool bCanPlaceGround = false;
+			const uint64* Words = Grid.GetTileWords(CellIndex);
+			for (int32 Word = 0; Word < CompiledTiles->NumMaskWords; Word++)
 			{
-				if (Cell.Entropy < MinEntropy)
+				if (Words[Word] & CompiledTiles->GroundTileMask[Word])
 				{
-					MinEntropy = Cell.Entropy;
-					GroundCandidates.Empty();
+					bCanPlaceGround = true;
+					break;
 				}
-				GroundCandidates.Add(Coord);
-				FoundGroundCandidate = true;
-			}
-			else if (FMath::IsNearlyEqual(Cell.Entropy, MinEntropy, 0.001f))
-			{
-				GroundCandidates.Add(Coord);
 			}
+			Key.Priority = bCanPlaceGround ? 0 : 1;
+			break;
 		}
-		else if (!FoundGroundCandidate)
+	case EWFCGenerationMode::LayeredBottomUp:
+		Key.Priority = Grid.GetCoordinate(CellIndex).Z;
+		break;
+	case EWFCGenerationMode::CenterOutward:
 		{
-			if (Cell.Entropy < MinEntropy)
-			{
-				MinEntropy = Cell.Entropy;
-				OtherCandidates.Empty();
-				OtherCandidates.Add(Coord);
-			}
-			else if (FMath::IsNearlyEqual(Cell.Entropy, MinEntropy, 0.001f))
-			{
-				OtherCandidates.Add(Coord);
-			}
+			const FWFCCoordinate Coord = Grid.GetCoordinate(CellIndex);
+			const FIntVector Center = Config.GridSize / 2;
+			const float Distance = FVector::Dist(
+				FVector(Coord.X, Coord.Y, Coord.Z),
+				FVector(Center.X, Center.Y, Center.Z)
+			);
+			//距离按0.5分段，同一段内再比较熵
+			Key.Priority = FMath::FloorToInt(Distance * 2.0f);
+			break;
 		}
+	default:
+		break;
 	}
 
-	if (GroundCandidates.Num() > 0)
-	{
-		int32 SelectedIndex = RandomGenerator.RandRange(0, GroundCandidates.Num() - 1);
-		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: GroundFirst selection - %d ground candidates, selected %s"),
-		       GroundCandidates.Num(), *GroundCandidates[SelectedIndex].ToString());
-		return GroundCandidates[SelectedIndex];
-	}
-
-	if (OtherCandidates.Num() > 0)
-	{
-		int32 SelectedIndex = RandomGenerator.RandRange(0, OtherCandidates.Num() - 1);
-		UE_LOG(LogTemp, VeryVerbose,
-		       TEXT("WFCCore: GroundFirst selection - no ground candidates, %d other candidates, selected %s"),
-		       OtherCandidates.Num(), *OtherCandidates[SelectedIndex].ToString());
-		return OtherCandidates[SelectedIndex];
-	}
-
-	return FWFCCoordinate(-1, -1, -1);
+	return Key;
 }
 
-FWFCCoordinate FWFCCore::SelectCellLayered()
+void FWFCCore::UpdateCellSelection(int32 CellIndex)
 {
-	for (int32 Z = 0; Z < Config.GridSize.Z; Z++)
+	const FWFCCell& Cell = Grid[CellIndex];
+	if (Cell.IsCollapsed() || Grid.GetPossibleTileCount(CellIndex) == 0)
 	{
-		float MinEntropy = FLT_MAX;
-		TArray<FWFCCoordinate> LayerCandidates;
-
-		for (int32 X = 0; X < Config.GridSize.X ; X++)
-		{
-			for (int32 Y = 0; Y < Config.GridSize.Y; Y++)
-			{
-				FWFCCoordinate Coord(X, Y, Z);
-				if (const FWFCCell* Cell = GetCell(Coord))
-				{
-					if (!Cell->IsCollapsed() && Cell->GetPossibleTileCount() > 0)
-					{
-						if (Cell->Entropy < MinEntropy)
-						{
-							MinEntropy = Cell->Entropy;
-							LayerCandidates.Empty();
-							LayerCandidates.Add(Coord);
-						}
-						else if (FMath::IsNearlyEqual(Cell->Entropy, MinEntropy, 0.001f))
-						{
-							LayerCandidates.Add(Coord);
-						}
-					}
-				}
-			}
-		}
-
-		if (LayerCandidates.Num() > 0)
-		{
-			int32 SelectedIndex = RandomGenerator.RandRange(0, LayerCandidates.Num() - 1);
-			UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Layered selection - layer %d, %d candidates, selected %s"),
-			       Z, LayerCandidates.Num(), *LayerCandidates[SelectedIndex].ToString());
-			return LayerCandidates[SelectedIndex];
-		}
+		SelectionHeap.Remove(CellIndex);
+		return;
 	}
 
-	return FWFCCoordinate(-1, -1, -1);
+	SelectionHeap.Update(CellIndex, GetSelectionKey(CellIndex));
 }
 
-FWFCCoordinate FWFCCore::SelectCellCenterOut()
+void FWFCCore::RebuildSelectionHeap()
 {
-	FIntVector Center = Config.GridSize / 2;
-	float MinEntropy = FLT_MAX;
-	float MinDistance = FLT_MAX;
-	TArray<FWFCCoordinate> CenterCandidates;
-
-	for (const auto& [Coord, Cell] : Grid)
+	SelectionHeap.Init(Grid.Num());
+	for (int32 CellIndex = 0; CellIndex < Grid.Num(); CellIndex++)
 	{
-		if (Cell.IsCollapsed() || Cell.GetPossibleTileCount() == 0) continue;
-
-		float Distance = FVector::Dist(
-			FVector(Coord.X, Coord.Y, Coord.Z),
-			FVector(Center.X, Center.Y, Center.Z)
-		);
-
-		if (Distance < MinDistance ||
-			(FMath::IsNearlyEqual(Distance, MinDistance, 0.5f) && Cell.Entropy < MinEntropy))
-		{
-			if (Distance < MinDistance)
-			{
-				MinDistance = Distance;
-				MinEntropy = Cell.Entropy;
-				CenterCandidates.Empty();
-				CenterCandidates.Add(Coord);
-			}
-			else if (FMath::IsNearlyEqual(Distance, MinDistance, 0.5f))
-			{
-				if (Cell.Entropy < MinEntropy)
-				{
-					MinEntropy = Cell.Entropy;
-					CenterCandidates.Empty();
-					CenterCandidates.Add(Coord);
-				}
-				else if (FMath::IsNearlyEqual(Cell.Entropy, MinEntropy, 0.001f))
-				{
-					CenterCandidates.Add(Coord);
-				}
-			}
-		}
+		UpdateCellSelection(CellIndex);
 	}
+}
 
-	if (CenterCandidates.Num() > 0)
+bool FWFCCore::CollapseCell(const FWFCCoordinate& Coord)
+{
+	const int32 CellIndex = Grid.GetIndex(Coord);
+	if (CellIndex == INDEX_NONE)
 	{
-		int32 SelectedIndex = RandomGenerator.RandRange(0, CenterCandidates.Num() - 1);
-		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: CenterOut selection - distance %.1f, %d candidates, selected %s"),
-		       MinDistance, CenterCandidates.Num(), *CenterCandidates[SelectedIndex].ToString());
-		return CenterCandidates[SelectedIndex];
+		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Cannot collapse - invalid coordinate %s"), *Coord.ToString());
+		return false;
 	}
-
-	return FWFCCoordinate(-1, -1, -1);
+	return CollapseCell(CellIndex);
 }
 
-bool FWFCCore::CollapseCell(const FWFCCoordinate& Coord)
+bool FWFCCore::CollapseCell(int32 CellIndex)
 {
-	FWFCCell* Cell = GetCell(Coord);
-	if (!Cell || Cell->IsCollapsed())
+	TRACE_CPUPROFILER_EVENT_SCOPE(FWFCCore::CollapseCell);
+	FWFCCell& Cell = Grid[CellIndex];
+	const FWFCCoordinate Coord = Grid.GetCoordinate(CellIndex);
+	if (Cell.IsCollapsed())
 	{
 		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Cannot collapse - cell is null or already collapsed at %s"),
 		       *Coord.ToString());
 		return false;
 	}
 
-	if (Cell->GetPossibleTileCount() == 0)
+	if (Grid.GetPossibleTileCount(CellIndex) == 0)
 	{
 		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Cannot collapse - no possible tiles at %s"), *Coord.ToString());
 		return false;
 	}
 
-	int32 SelectedTile = SelectRandomTile(*Cell, Coord);
+	const int32 RandomState = RandomGenerator.GetCurrentSeed();
+	int32 SelectedTile = SelectRandomTile(CellIndex, Coord);
+	if (bRecordReplay)
+	{
+		ReplayLog.Decisions.Add({CellIndex, SelectedTile < 0 ? INDEX_NONE : SelectedTile, RandomState});
+	}
 
 	if (SelectedTile < 0)
 	{
@@ -699,103 +1191,116 @@ bool FWFCCore::CollapseCell(const FWFCCoordinate& Coord)
 	}
 
 
-	if (!CheckConstraints(Coord, SelectedTile))
+	if (!CheckConstraints(CellIndex, SelectedTile))
 	{
 		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Constraint check failed for tile %d at %s"),
 		       SelectedTile, *Coord.ToString());
 		return false;
 	}
 
-	Cell->bCollapsed = true;
-	Cell->CollapsedTileIndex = SelectedTile;
-	Cell->PossibleTiles.SetRange(0, Cell->PossibleTiles.Num(), false);
-	Cell->PossibleTiles[SelectedTile] = true;
-	Cell->Entropy = 0.0f;
+	BanCollapsedAlternatives(CellIndex, SelectedTile);
+	RecordTrail(CellIndex, INDEX_NONE);
+
+	Cell.bCollapsed = true;
+	Cell.CollapsedTileIndex = SelectedTile;
+	Grid.SetSinglePossibleTile(CellIndex, SelectedTile);
+	Cell.SumWeights = CompiledTiles->Weights[SelectedTile];
+	Cell.SumWeightLogWeights = CompiledTiles->WeightLogWeights[SelectedTile];
+	Cell.Entropy = 0.0f;
+	SelectionHeap.Remove(CellIndex);
 
 	TileInstanceCounts.FindOrAdd(SelectedTile, 0)++;
 
 	CollapseHistory.Add(Coord);
 
-	QueuePropagation(Coord);
+	QueuePropagation(CellIndex);
 
-	LogGenerationStep(Coord, SelectedTile);
+	LogGenerationStep(CellIndex, SelectedTile);
 
-	if (OnStatusUpdate.IsBound())
-	{
-		AsyncTask(ENamedThreads::GameThread, [this, Coord, SelectedTile]()
-		{
-			OnStatusUpdate.Execute(Coord, SelectedTile);
-		});
-	}
+	PostStatusEvent(Coord, SelectedTile);
 
 	return true;
 }
 
 bool FWFCCore::CollapseCellTo(const FWFCCoordinate& Coord, int32 TileIndex)
 {
-	FWFCCell* Cell = GetCell(Coord);
-	if (!Cell || Cell->IsCollapsed())
+	const int32 CellIndex = Grid.GetIndex(Coord);
+	if (CellIndex == INDEX_NONE)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Cannot collapse - invalid coordinate %s"), *Coord.ToString());
+		return false;
+	}
+	return CollapseCellTo(CellIndex, TileIndex);
+}
+
+bool FWFCCore::CollapseCellTo(int32 CellIndex, int32 TileIndex)
+{
+	FWFCCell& Cell = Grid[CellIndex];
+	const FWFCCoordinate Coord = Grid.GetCoordinate(CellIndex);
+	if (Cell.IsCollapsed())
 	{
 		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Cannot collapse - cell is null or already collapsed at %s"),
 		       *Coord.ToString());
 		return false;
 	}
 
-	if (Cell->GetPossibleTileCount() == 0)
+	if (Grid.GetPossibleTileCount(CellIndex) == 0)
 	{
 		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Cannot collapse - no possible tiles at %s"), *Coord.ToString());
 		return false;
 	}
 
-	int32 SelectedTile = 0;
+	if (!Grid.CanPlace(CellIndex, TileIndex))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Cannot collapse - tile %d is not possible at %s"), TileIndex,
+		       *Coord.ToString());
+		return false;
+	}
+
+	const int32 SelectedTile = TileIndex;
 
-	Cell->bCollapsed = true;
-	Cell->CollapsedTileIndex = SelectedTile;
-	Cell->PossibleTiles.SetRange(0, Cell->PossibleTiles.Num(), false);
-	Cell->PossibleTiles[SelectedTile] = true;
-	Cell->Entropy = 0.0f;
+	BanCollapsedAlternatives(CellIndex, SelectedTile);
+	RecordTrail(CellIndex, INDEX_NONE);
+
+	Cell.bCollapsed = true;
+	Cell.CollapsedTileIndex = SelectedTile;
+	Grid.SetSinglePossibleTile(CellIndex, SelectedTile);
+	Cell.SumWeights = CompiledTiles->Weights[SelectedTile];
+	Cell.SumWeightLogWeights = CompiledTiles->WeightLogWeights[SelectedTile];
+	Cell.Entropy = 0.0f;
+	SelectionHeap.Remove(CellIndex);
 
 	TileInstanceCounts.FindOrAdd(SelectedTile, 0)++;
 
 	CollapseHistory.Add(Coord);
 
-	QueuePropagation(Coord);
+	QueuePropagation(CellIndex);
 
-	LogGenerationStep(Coord, SelectedTile);
+	LogGenerationStep(CellIndex, SelectedTile);
 
-	if (OnStatusUpdate.IsBound())
-	{
-		AsyncTask(ENamedThreads::GameThread, [this, Coord, SelectedTile]()
-		{
-			OnStatusUpdate.Execute(Coord, SelectedTile);
-		});
-	}
+	PostStatusEvent(Coord, SelectedTile);
 
 	return true;
 }
 
-int32 FWFCCore::SelectRandomTile(const FWFCCell& Cell, const FWFCCoordinate& Coord)
+int32 FWFCCore::SelectRandomTile(int32 CellIndex, const FWFCCoordinate& Coord)
 {
 	TArray<int32> ValidTiles;
 	TArray<float> Weights;
 
-	for (int32 i = 0; i < Cell.PossibleTiles.Num(); i++)
+	Grid.ForEachPossibleTile(CellIndex, [&](int32 i)
 	{
-		if (Cell.PossibleTiles[i])
+		if (!CheckDecorators(i, Coord))
 		{
-			FWFCTileDefinition TileDef = TileSet->GetTile(i);
-			if (!CheckDecorators(i, TileDef, Coord))
-			{
-				continue;
-			}
-			/*if (IsEdgeCoordinate(Coord) && !CheckCanAtEdge(TileDef, Coord))
-			{
-				continue;
-			}*/
-			ValidTiles.Add(i);
-			Weights.Add(FMath::Max(TileDef.Weight, 0.01f)); //确保权重为正
+			return;
 		}
-	}
+		/*if (IsEdgeCoordinate(Coord) && !CheckCanAtEdge(TileSet->Tiles[i], Coord))
+		{
+			return;
+		}*/
+		ValidTiles.Add(i);
+		Weights.Add(FMath::Max(CompiledTiles->Weights[i], 0.01f)); //确保权重为正
+	});
 
 	if (ValidTiles.Num() == 0)
 	{
@@ -824,7 +1329,7 @@ int32 FWFCCore::SelectRandomTile(const FWFCCell& Cell, const FWFCCoordinate& Coo
 	for (int32 i = 0; i < ValidTiles.Num(); i++)
 	{
 		//跳过empty连接方块，将其作为最后保底选择
-		if (TileSet->GetTile(ValidTiles[i]).Category == EWFCTileCategory::Empty)
+		if (CompiledTiles->IsEmptyTile(ValidTiles[i]))
 		{
 			continue;
 		}
@@ -840,192 +1345,399 @@ int32 FWFCCore::SelectRandomTile(const FWFCCell& Cell, const FWFCCoordinate& Coo
 
 bool FWFCCore::PropagateConstraints()
 {
+	TRACE_CPUPROFILER_EVENT_SCOPE(FWFCCore::PropagateConstraints);
+	if (IsSupportCountMode())
+	{
+		return PropagateSupport();
+	}
+
 	int32 PropagationSteps = 0;
-	const int32 MaxPropagationSteps = Config.GridSize.X * Config.GridSize.Y * Config.GridSize.Z * 10;
+	const int32 MaxPropagationSteps = Grid.Num() * 10;
 
-	while (!PropagationQueue.IsEmpty() && PropagationSteps < MaxPropagationSteps)
+	while (PropagationQueue.Num() > 0 && PropagationSteps < MaxPropagationSteps)
 	{
-		
-		FWFCCoordinate CurrentCoord;
-		PropagationQueue.Dequeue(CurrentCoord);
+		const int32 CurrentCell = PropagationQueue.Pop(EAllowShrinking::No);
+		QueuedCells[CurrentCell] = false;
 		PropagationSteps++;
-		if (!PropagateFrom(CurrentCoord))
+		if (!PropagateFrom(CurrentCell))
 		{
 			UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Propagation failed from %s at step %d"),
-			       *CurrentCoord.ToString(), PropagationSteps);
+			       *Grid.GetCoordinate(CurrentCell).ToString(), PropagationSteps);
 			return false;
 		}
 	}
 
 	if (PropagationSteps >= MaxPropagationSteps)
 	{
-		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Propagation reached maximum steps (%d), possible infinite loop"),
-		       MaxPropagationSteps);
+		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Propagation reached maximum steps (%d), possible infinite loop"),
+		       MaxPropagationSteps);
+		return false;
+	}
+
+	UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Propagation completed in %d steps"), PropagationSteps);
+	return true;
+}
+
+template <int32 NumWords>
+bool FWFCCore::PropagateSupportWords()
+{
+	const int32 Words = NumWords > 0 ? NumWords : MaskWords;
+	const int32 TileCount = Grid.GetTileCount();
+	int32 BanSteps = 0;
+	bool bContradiction = false;
+
+	//出现矛盾后仍需处理完队列，保证计数与格子状态一致，回溯时才能正确恢复
+	while (BanQueue.Num() > 0)
+	{
+		const FWFCBan Ban = BanQueue.Pop(EAllowShrinking::No);
+		BanSteps++;
+
+		for (int32 Dir = 0; Dir < FWFCGrid::NumDirections; Dir++)
+		{
+			const int32 NeighborIndex = Grid.GetNeighborIndex(Ban.CellIndex, Dir);
+			if (NeighborIndex == INDEX_NONE)
+			{
+				continue;
+			}
+
+			//邻居看向被移除瓦片所在格子的方向为Dir的反方向
+			const int32 OppositeDir = Dir ^ 1;
+			int32* NeighborCounts = SupportCounts.GetData() + NeighborIndex * TileCount * FWFCGrid::NumDirections;
+			FWFCCell& NeighborCell = Grid[NeighborIndex];
+
+			FWFCTileMask::ForEachSetBit(GetCompatibilityMask(Dir, Ban.TileIndex), Words, [&](int32 NeighborTile)
+			{
+				int32& Count = NeighborCounts[NeighborTile * FWFCGrid::NumDirections + OppositeDir];
+				if (--Count != 0 || !Grid.CanPlace(NeighborIndex, NeighborTile))
+				{
+					return;
+				}
+
+				if (NeighborCell.IsCollapsed())
+				{
+					UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Collapsed cell %s lost support for tile %d"),
+					       *Grid.GetCoordinate(NeighborIndex).ToString(), NeighborTile);
+					RecordConflict(NeighborIndex, Ban.CellIndex);
+					bContradiction = true;
+					return;
+				}
+
+				if (!RemoveTileOption(NeighborIndex, NeighborTile, true, Ban.CellIndex))
+				{
+					bContradiction = true;
+				}
+			});
+		}
+	}
+
+	Stats.Propagations += BanSteps;
+	if (bContradiction)
+	{
+		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Support propagation found a contradiction after %d bans"), BanSteps);
 		return false;
 	}
 
-	UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Propagation completed in %d steps"), PropagationSteps);
+	UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Support propagation completed in %d bans"), BanSteps);
 	return true;
 }
 
-bool FWFCCore::PropagateFrom(const FWFCCoordinate& Coord)
+void FWFCCore::RestoreSupport(int32 CellIndex, int32 TileIndex)
 {
-	const FWFCCell* SourceCell = GetCell(Coord);
-	if (!SourceCell)
+	const int32 TileCount = Grid.GetTileCount();
+	for (int32 Dir = 0; Dir < FWFCGrid::NumDirections; Dir++)
 	{
-		return true;
+		const int32 NeighborIndex = Grid.GetNeighborIndex(CellIndex, Dir);
+		if (NeighborIndex == INDEX_NONE)
+		{
+			continue;
+		}
+
+		const int32 OppositeDir = Dir ^ 1;
+		int32* NeighborCounts = SupportCounts.GetData() + NeighborIndex * TileCount * FWFCGrid::NumDirections;
+		FWFCTileMask::ForEachSetBit(GetCompatibilityMask(Dir, TileIndex), MaskWords, [&](int32 NeighborTile)
+		{
+			NeighborCounts[NeighborTile * FWFCGrid::NumDirections + OppositeDir]++;
+		});
 	}
+}
 
-	for (int32 Dir = 0; Dir < 6; Dir++)
+//坍缩时逐个记录被排除的瓦片以便回溯；AC-4下邻居计数也要随之递减
+void FWFCCore::BanCollapsedAlternatives(int32 CellIndex, int32 KeepTile)
+{
+	Grid.ForEachPossibleTile(CellIndex, [this, CellIndex, KeepTile](int32 TileIndex)
 	{
-		FWFCCoordinate NeighborCoord = GetNeighbor(Coord, static_cast<EWFCDirection>(Dir));
-		FWFCCell* NeighborCell = GetCell(NeighborCoord);
+		if (TileIndex == KeepTile)
+		{
+			return;
+		}
 
-		if (!NeighborCell || NeighborCell->IsCollapsed())
+		RecordTrail(CellIndex, TileIndex);
+		Stats.Bans++;
+		if (IsSupportCountMode())
 		{
-			continue;
+			BanQueue.Add({CellIndex, TileIndex});
+			Stats.QueuePushes++;
 		}
+	});
+}
+
+bool FWFCCore::PropagateFrom(const FWFCCoordinate& Coord)
+{
+	const int32 CellIndex = Grid.GetIndex(Coord);
+	return CellIndex == INDEX_NONE || PropagateFrom(CellIndex);
+}
+
+template <int32 NumWords>
+bool FWFCCore::PropagateFromWords(int32 CellIndex)
+{
+	//固定字数时循环次数是编译期常量，允许集合放在栈上
+	const int32 Words = NumWords > 0 ? NumWords : MaskWords;
+	uint64 InlineAllowed[NumWords > 0 ? NumWords : 1];
+	uint64* Allowed = NumWords > 0 ? InlineAllowed : AllowedScratch.GetData();
 
-		TArray<int32> TilesToRemove;
-		for (int32 NeighborTile = 0; NeighborTile < NeighborCell->PossibleTiles.Num(); NeighborTile++)
+	Stats.Propagations++;
+	const uint64* SourceWords = Grid.GetTileWords(CellIndex);
+
+	for (int32 Dir = 0; Dir < FWFCGrid::NumDirections; Dir++)
+	{
+		const int32 NeighborIndex = Grid.GetNeighborIndex(CellIndex, Dir);
+		if (NeighborIndex == INDEX_NONE)
 		{
-			if (!NeighborCell->PossibleTiles[NeighborTile])
-			{
-				continue;
-			}
+			continue;
+		}
+
+		FWFCCell& NeighborCell = Grid[NeighborIndex];
 
-			bool HasSupport = false;
-			for (int32 SourceTile = 0; SourceTile < SourceCell->PossibleTiles.Num(); SourceTile++)
+		//源格子所有可能瓦片在该方向上允许的邻居集合
+		FMemory::Memzero(Allowed, Words * sizeof(uint64));
+		FWFCTileMask::ForEachSetBit(SourceWords, Words, [this, Dir, Allowed, Words](int32 SourceTile)
+		{
+			const uint64* Mask = GetCompatibilityMask(Dir, SourceTile);
+			for (int32 Word = 0; Word < Words; Word++)
 			{
-				if (SourceCell->PossibleTiles[SourceTile] &&
-					PropagationRules[Dir][SourceTile].Contains(NeighborTile))
-				{
-					HasSupport = true;
-					break;
-				}
+				Allowed[Word] |= Mask[Word];
 			}
+		});
 
-			if (!HasSupport)
+		//已坍缩的邻居不再缩减，但它的瓦片必须仍被允许，否则两个同时自动坍缩的格子可能互不兼容
+		if (NeighborCell.IsCollapsed())
+		{
+			const int32 NeighborTile = NeighborCell.CollapsedTileIndex;
+			if (!(Allowed[NeighborTile / FWFCTileMask::BitsPerWord] & (1ull << (NeighborTile % FWFCTileMask::BitsPerWord))))
 			{
-				TilesToRemove.Add(NeighborTile);
+				UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Collapsed cell %s lost support for tile %d"),
+				       *Grid.GetCoordinate(NeighborIndex).ToString(), NeighborTile);
+				RecordConflict(NeighborIndex, CellIndex);
+				return false;
 			}
+			continue;
 		}
 
-		for (int32 TileToRemove : TilesToRemove)
+		uint64* NeighborWords = Grid.GetTileWords(NeighborIndex);
+		int32 LastRemovedTile = INDEX_NONE;
+		for (int32 Word = 0; Word < Words; Word++)
 		{
-			if (!RemoveTileOption(NeighborCoord, TileToRemove))
+			const uint64 Removed = NeighborWords[Word] & ~Allowed[Word];
+			if (Removed == 0)
 			{
-				return false;
+				continue;
 			}
 
-			LogPropagationStep(Coord, NeighborCoord, TileToRemove);
+			NeighborWords[Word] &= Allowed[Word];
+			FWFCTileMask::ForEachSetBit(&Removed, 1, [&](int32 Bit)
+			{
+				LastRemovedTile = Word * FWFCTileMask::BitsPerWord + Bit;
+				RemoveTileWeight(NeighborCell, LastRemovedTile);
+				RecordTrail(NeighborIndex, LastRemovedTile, CellIndex);
+			});
+			Stats.Bans += FMath::CountBits(Removed);
+		}
+
+		if (LastRemovedTile != INDEX_NONE && !OnTileOptionsRemoved(NeighborIndex, LastRemovedTile))
+		{
+			return false;
 		}
 	}
 
 	return true;
 }
 
+void FWFCCore::SelectPropagationKernels()
+{
+	switch (MaskWords)
+	{
+	case 1:
+		PropagateFromKernel = &FWFCCore::PropagateFromWords<1>;
+		PropagateSupportKernel = &FWFCCore::PropagateSupportWords<1>;
+		break;
+	case 2:
+		PropagateFromKernel = &FWFCCore::PropagateFromWords<2>;
+		PropagateSupportKernel = &FWFCCore::PropagateSupportWords<2>;
+		break;
+	case 3:
+		PropagateFromKernel = &FWFCCore::PropagateFromWords<3>;
+		PropagateSupportKernel = &FWFCCore::PropagateSupportWords<3>;
+		break;
+	case 4:
+		PropagateFromKernel = &FWFCCore::PropagateFromWords<4>;
+		PropagateSupportKernel = &FWFCCore::PropagateSupportWords<4>;
+		break;
+	default:
+		PropagateFromKernel = &FWFCCore::PropagateFromWords<0>;
+		PropagateSupportKernel = &FWFCCore::PropagateSupportWords<0>;
+		break;
+	}
+}
+
 bool FWFCCore::RemoveTileOption(const FWFCCoordinate& Coord, int32 TileIndex, bool bTrackChanges)
 {
-	auto tile = TileSet->GetTile(TileIndex);
-	FWFCCell* Cell = GetCell(Coord);
+	const int32 CellIndex = Grid.GetIndex(Coord);
+	return CellIndex == INDEX_NONE || RemoveTileOption(CellIndex, TileIndex, bTrackChanges);
+}
+
+bool FWFCCore::RemoveTileOption(int32 CellIndex, int32 TileIndex, bool bTrackChanges, int32 ReasonCell)
+{
+	FWFCCell& Cell = Grid[CellIndex];
 
-	if (!Cell || TileIndex < 0 || TileIndex >= Cell->PossibleTiles.Num() || !Cell->PossibleTiles[TileIndex])
+	if (!Grid.CanPlace(CellIndex, TileIndex))
 	{
 		return true;
 	}
 
-	if (bTrackChanges && ChangeHistory.Num() > 0)
+	if (bTrackChanges)
+	{
+		RecordTrail(CellIndex, TileIndex, ReasonCell);
+	}
+
+	Grid.SetPossibleTile(CellIndex, TileIndex, false);
+	RemoveTileWeight(Cell, TileIndex);
+	Stats.Bans++;
+	if (IsSupportCountMode())
 	{
-		ChangeHistory.Last().Emplace(Coord, TileIndex, true);
+		BanQueue.Add({CellIndex, TileIndex});
+		Stats.QueuePushes++;
 	}
+	return OnTileOptionsRemoved(CellIndex, TileIndex);
+}
 
-	Cell->PossibleTiles[TileIndex] = false;
-	Cell->Entropy = CalculateEntropy(*Cell);
+//一个或多个瓦片已从格子中移除后，更新熵并处理矛盾或自动坍缩
+bool FWFCCore::OnTileOptionsRemoved(int32 CellIndex, int32 LastRemovedTile)
+{
+	FWFCCell& Cell = Grid[CellIndex];
+	Cell.Entropy = CalculateEntropy(Cell);
 
-	int32 RemainingOptions = Cell->GetPossibleTileCount();
+	int32 RemainingOptions = Grid.GetPossibleTileCount(CellIndex);
 	if (RemainingOptions == 0)
 	{
 		UE_LOG(LogTemp, Log, TEXT("WFCCore: Cell at %s has no remaining options after removing tile %d"),
-		       *Coord.ToString(), TileIndex);
+		       *Grid.GetCoordinate(CellIndex).ToString(), LastRemovedTile);
+		SelectionHeap.Remove(CellIndex);
+		RecordConflict(CellIndex);
 		return false;
 	}
 
-	if (RemainingOptions == 1 && !Cell->IsCollapsed())
+	if (RemainingOptions == 1 && !Cell.IsCollapsed())
 	{
-		for (int32 i = 0; i < Cell->PossibleTiles.Num(); i++)
-		{
-			if (Cell->PossibleTiles[i])
-			{
-				Cell->bCollapsed = true;
-				Cell->CollapsedTileIndex = i;
-				TileInstanceCounts.FindOrAdd(i, 0)++;
-				CollapseHistory.Add(Coord);
+		const int32 i = Grid.FindFirstPossibleTile(CellIndex);
+		const FWFCCoordinate Coord = Grid.GetCoordinate(CellIndex);
+		RecordTrail(CellIndex, INDEX_NONE);
+		Cell.bCollapsed = true;
+		Cell.CollapsedTileIndex = i;
+		TileInstanceCounts.FindOrAdd(i, 0)++;
+		CollapseHistory.Add(Coord);
 
-				if (OnStatusUpdate.IsBound())
-				{
-					AsyncTask(ENamedThreads::GameThread, [this, Coord, i]()
-					{
-						OnStatusUpdate.Execute(Coord, i);
-					});
-				}
-				UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Auto-collapsed cell %s to tile %d"),
-				       *Coord.ToString(), i);
-				break;
-			}
-		}
+		PostStatusEvent(Coord, i);
+		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Auto-collapsed cell %s to tile %d"),
+		       *Coord.ToString(), i);
 	}
 
-	QueuePropagation(Coord);
+	UpdateCellSelection(CellIndex);
+
+	if (!IsSupportCountMode())
+	{
+		QueuePropagation(CellIndex);
+	}
 
 	return true;
 }
 
 void FWFCCore::QueuePropagation(const FWFCCoordinate& Coord)
 {
-	PropagationQueue.Enqueue(Coord);
+	const int32 CellIndex = Grid.GetIndex(Coord);
+	if (CellIndex != INDEX_NONE)
+	{
+		QueuePropagation(CellIndex);
+	}
 }
 
-float FWFCCore::CalculateEntropy(const FWFCCell& Cell) const
+void FWFCCore::QueuePropagation(int32 CellIndex)
 {
-	if (Cell.IsCollapsed())
+	//同一格子在队列中只保留一份
+	if (!QueuedCells[CellIndex])
 	{
-		return 0.0f;
+		QueuedCells[CellIndex] = true;
+		PropagationQueue.Add(CellIndex);
+		Stats.QueuePushes++;
 	}
+}
 
-	float TotalWeight = 0.0f;
-	float WeightLogWeight = 0.0f;
+void FWFCCore::ClearPropagationQueue()
+{
+	for (int32 CellIndex : PropagationQueue)
+	{
+		QueuedCells[CellIndex] = false;
+	}
+	PropagationQueue.Reset();
+	BanQueue.Reset();
+}
 
-	for (int32 i = 0; i < Cell.PossibleTiles.Num(); i++)
+float FWFCCore::CalculateEntropy(const FWFCCell& Cell) const
+{
+	if (Cell.IsCollapsed())
 	{
-		if (Cell.PossibleTiles[i])
-		{
-			float Weight = TileSet->GetTile(i).Weight;
-			TotalWeight += Weight;
-			if (Weight > 0.0f)
-			{
-				WeightLogWeight += Weight * FMath::Loge(Weight);
-			}
-		}
+		return 0.0f;
 	}
 
-	if (TotalWeight > 0.0f)
+	if (Cell.SumWeights > 0.0)
 	{
-		return FMath::Loge(TotalWeight) - (WeightLogWeight / TotalWeight);
+		return static_cast<float>(FMath::Loge(Cell.SumWeights) - Cell.SumWeightLogWeights / Cell.SumWeights);
 	}
 
 	return 0.0f;
 }
 
+void FWFCCore::AddTileWeight(FWFCCell& Cell, int32 TileIndex) const
+{
+	Cell.SumWeights += CompiledTiles->Weights[TileIndex];
+	Cell.SumWeightLogWeights += CompiledTiles->WeightLogWeights[TileIndex];
+}
+
+void FWFCCore::RemoveTileWeight(FWFCCell& Cell, int32 TileIndex) const
+{
+	Cell.SumWeights -= CompiledTiles->Weights[TileIndex];
+	Cell.SumWeightLogWeights -= CompiledTiles->WeightLogWeights[TileIndex];
+}
+
+void FWFCCore::RecalculateCellWeights(int32 CellIndex)
+{
+	FWFCCell& Cell = Grid[CellIndex];
+	Cell.SumWeights = 0.0;
+	Cell.SumWeightLogWeights = 0.0;
+	Grid.ForEachPossibleTile(CellIndex, [this, &Cell](int32 TileIndex)
+	{
+		AddTileWeight(Cell, TileIndex);
+	});
+}
+
 //TODO:InstanceLimit的检查有问题，需要修改
-bool FWFCCore::CheckConstraints(const FWFCCoordinate& Coord, int32 TileIndex) const
+bool FWFCCore::CheckConstraints(int32 CellIndex, int32 TileIndex) const
 {
 	/*if (!CheckInstanceLimits(TileIndex))
 	{
 		return false;
 	}*/
 
-	if (!CheckSupportRequirement(Coord, TileIndex))
+	if (!CheckSupportRequirement(CellIndex, TileIndex))
 	{
 		return false;
 	}
@@ -1050,37 +1762,33 @@ bool FWFCCore::CheckInstanceLimits(int32 TileIndex) const
 	return CurrentCount < TileDef.MaxInstancesPerGeneration;
 }
 
-bool FWFCCore::CheckSupportRequirement(const FWFCCoordinate& Coord, int32 TileIndex) const
+bool FWFCCore::CheckSupportRequirement(int32 CellIndex, int32 TileIndex) const
 {
-	FWFCTileDefinition TileDef = TileSet->GetTile(TileIndex);
-	if (!TileDef.bRequiresSupport)
+	if (!CompiledTiles->RequiresSupport[TileIndex])
 	{
 		return true;
 	}
 
-	FWFCCoordinate BelowCoord = GetNeighbor(Coord, EWFCDirection::Down);
-	const FWFCCell* BelowCell = GetCell(BelowCoord);
-
-	if (!BelowCell)
+	const int32 BelowIndex = Grid.GetNeighborIndex(CellIndex, static_cast<int32>(EWFCDirection::Down));
+	if (BelowIndex == INDEX_NONE)
 	{
-		return Coord.Z == 0;
+		return Grid.GetCoordinate(CellIndex).Z == 0;
 	}
 
+	const FWFCCell* BelowCell = &Grid[BelowIndex];
+
 	if (BelowCell->IsCollapsed())
 	{
-		FWFCTileDefinition BelowTile = TileSet->GetTile(BelowCell->CollapsedTileIndex);
-		return BelowTile.Category != EWFCTileCategory::Empty;
+		return !CompiledTiles->IsEmptyTile(BelowCell->CollapsedTileIndex);
 	}
 
-	for (int32 i = 0; i < BelowCell->PossibleTiles.Num(); i++)
+	//下方格子只要还有非空瓦片可能即可
+	const uint64* BelowWords = Grid.GetTileWords(BelowIndex);
+	for (int32 Word = 0; Word < CompiledTiles->NumMaskWords; Word++)
 	{
-		if (BelowCell->PossibleTiles[i])
+		if (BelowWords[Word] & ~CompiledTiles->EmptyTileMask[Word])
 		{
-			FWFCTileDefinition BelowTile = TileSet->GetTile(i);
-			if (BelowTile.Category != EWFCTileCategory::Empty)
-			{
-				return true;
-			}
+			return true;
 		}
 	}
 
@@ -1090,82 +1798,274 @@ bool FWFCCore::CheckSupportRequirement(const FWFCCoordinate& Coord, int32 TileIn
 bool FWFCCore::CanBacktrack() const
 {
 	return Config.bEnableBacktracking &&
-		ChangeHistory.Num() > 0 &&
-		ChangeHistory.Num() <= Config.BacktrackingDepth;
+		Checkpoints.Num() > 0 &&
+		BacktrackCount < Config.MaxBacktracks;
 }
 
-void FWFCCore::SaveState()
+void FWFCCore::SaveState(int32 CellIndex)
 {
-	ChangeHistory.Emplace();
+	if (Checkpoints.Num() == 0)
+	{
+		CellTrailHead.Init(INDEX_NONE, Grid.Num());
+	}
+	ConflictCells.Reset();
+	Checkpoints.Add({Trail.Num(), CollapseHistory.Num(), CellIndex, INDEX_NONE});
 }
 
-bool FWFCCore::Backtrack()
+//按记录的逆序撤销，权重和增量恢复，同一格子连续的记录只更新一次熵与选择堆
+void FWFCCore::UndoTrail(int32 ToSize)
 {
-	if (ChangeHistory.Num() == 0)
+	int32 PendingCell = INDEX_NONE;
+	for (int32 i = Trail.Num() - 1; i >= ToSize; i--)
 	{
-		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Cannot backtrack - no history available"));
-		return false;
+		const FWFCTrailEntry& Entry = Trail[i];
+		FWFCCell& Cell = Grid[Entry.CellIndex];
+		if (PendingCell != INDEX_NONE && PendingCell != Entry.CellIndex)
+		{
+			Grid[PendingCell].Entropy = CalculateEntropy(Grid[PendingCell]);
+			UpdateCellSelection(PendingCell);
+		}
+		PendingCell = Entry.CellIndex;
+		CellTrailHead[Entry.CellIndex] = Entry.PrevForCell;
+
+		if (Entry.TileIndex == INDEX_NONE)
+		{
+			if (int32* Count = TileInstanceCounts.Find(Cell.CollapsedTileIndex))
+			{
+				if (--(*Count) <= 0)
+				{
+					TileInstanceCounts.Remove(Cell.CollapsedTileIndex);
+				}
+			}
+			Cell.bCollapsed = false;
+			Cell.CollapsedTileIndex = -1;
+			continue;
+		}
+
+		Grid.SetPossibleTile(Entry.CellIndex, Entry.TileIndex, true);
+		AddTileWeight(Cell, Entry.TileIndex);
+		if (IsSupportCountMode())
+		{
+			RestoreSupport(Entry.CellIndex, Entry.TileIndex);
+		}
+	}
+
+	if (PendingCell != INDEX_NONE)
+	{
+		Grid[PendingCell].Entropy = CalculateEntropy(Grid[PendingCell]);
+		UpdateCellSelection(PendingCell);
+	}
+	Trail.SetNum(ToSize, EAllowShrinking::No);
+}
+
+void FWFCCore::RestoreState(int32 ToDepth)
+{
+	if (ToDepth < 0 || ToDepth >= Checkpoints.Num())
+	{
+		return;
+	}
+
+	const FWFCCheckpoint& Checkpoint = Checkpoints[ToDepth];
+	UndoTrail(Checkpoint.TrailSize);
+	CollapseHistory.SetNum(Checkpoint.CollapseHistorySize, EAllowShrinking::No);
+	Checkpoints.SetNum(ToDepth, EAllowShrinking::No);
+}
+
+//沿轨迹追溯矛盾格子上每次移除来自哪个格子，直到追到选择本身，得到矛盾依赖的选择层
+//返回值以下的层全部计入冲突集，OutLevels中另外标记单独依赖的层
+int32 FWFCCore::AnalyzeConflict(TBitArray<>& OutLevels) const
+{
+	if (!Config.bEnableBackjumping || ConflictCells.Num() == 0)
+	{
+		return Checkpoints.Num();
 	}
 
-	UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Backtracking from depth %d"), ChangeHistory.Num());
+	int32 DenseLevel = 0;
+	//每个格子已处理过下标小于该值的轨迹项
+	TMap<int32, int32> VisitedBounds;
+	TArray<TPair<int32, int32>> Pending;
+	for (const int32 CellIndex : ConflictCells)
+	{
+		Pending.Emplace(CellIndex, Trail.Num());
+	}
 
-	const TArray<FWFCChange>& LastChanges = ChangeHistory.Last();
-	for (int32 i = LastChanges.Num() - 1; i >= 0; i--)
+	while (Pending.Num() > 0)
 	{
-		const FWFCChange& Change = LastChanges[i];
-		FWFCCell* Cell = GetCell(Change.Position);
-		if (Cell && Change.TileIndex >= 0 && Change.TileIndex < Cell->PossibleTiles.Num())
+		const TPair<int32, int32> Item = Pending.Pop(EAllowShrinking::No);
+		const int32 VisitedBound = VisitedBounds.FindRef(Item.Key);
+		if (Item.Value <= VisitedBound)
+		{
+			continue;
+		}
+
+		for (int32 Index = CellTrailHead[Item.Key]; Index != INDEX_NONE && Index >= VisitedBound; Index = Trail[Index].PrevForCell)
 		{
-			Cell->PossibleTiles[Change.TileIndex] = !Change.bWasRemoved;
-			Cell->Entropy = CalculateEntropy(*Cell);
+			const FWFCTrailEntry& Entry = Trail[Index];
+			if (Index >= Item.Value || Entry.TileIndex == INDEX_NONE)
+			{
+				continue;
+			}
 
-			UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Restored tile %d at %s (was %s)"),
-			       Change.TileIndex, *Change.Position.ToString(), Change.bWasRemoved ? TEXT("removed") : TEXT("added"));
+			if (Entry.ReasonCell != INDEX_NONE)
+			{
+				Pending.Emplace(Entry.ReasonCell, Index);
+			}
+			else if (Entry.bLearned)
+			{
+				DenseLevel = FMath::Max(DenseLevel, Entry.ReasonLevel);
+			}
+			else
+			{
+				OutLevels[Entry.ReasonLevel] = true;
+			}
 		}
+		VisitedBounds.Add(Item.Key, Item.Value);
+	}
+
+	return DenseLevel;
+}
+
+//回退到冲突集中最深的选择并禁用该选择的瓦片；禁用后仍矛盾时合并新的冲突集继续回退
+//未开启回跳时冲突集为全部层，即逐层回退
+bool FWFCCore::Backtrack()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FWFCCore::Backtrack);
+	Stats.Backtracks++;
+	//先处理完未完成的递减，恢复时的递增才能与之对应
+	if (IsSupportCountMode())
+	{
+		PropagateSupport();
 	}
+	ClearPropagationQueue();
+
+	TBitArray<> ConflictLevels(false, Checkpoints.Num() + 1);
+	int32 DenseLevel = AnalyzeConflict(ConflictLevels);
+	ConflictCells.Reset();
 
-	ChangeHistory.Pop();
-	if (CollapseHistory.Num() > 0)
+	int32 Unwound = 0;
+	while (Checkpoints.Num() > 0 && Unwound < Config.BacktrackingDepth && BacktrackCount < Config.MaxBacktracks)
 	{
-		FWFCCoordinate LastCollapse = CollapseHistory.Pop();
-		FWFCCell* Cell = GetCell(LastCollapse);
-		if (Cell)
+		int32 TargetLevel = FMath::Min(DenseLevel, Checkpoints.Num());
+		for (int32 Level = Checkpoints.Num(); Level > TargetLevel; Level--)
+		{
+			if (ConflictLevels[Level])
+			{
+				TargetLevel = Level;
+				break;
+			}
+		}
+
+		if (TargetLevel == 0)
 		{
-			int32 CollapsedTile = Cell->CollapsedTileIndex;
-			Cell->bCollapsed = false;
-			Cell->CollapsedTileIndex = -1;
+			UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Contradiction does not depend on any choice, cannot backtrack"));
+			return false;
+		}
 
-			if (int32* Count = TileInstanceCounts.Find(CollapsedTile))
+		const FWFCCheckpoint Checkpoint = Checkpoints[TargetLevel - 1];
+		Unwound += Checkpoints.Num() - TargetLevel + 1;
+		BacktrackCount++;
+		RestoreState(TargetLevel - 1);
+
+		//剩余的冲突集即禁用该选择的依据
+		ConflictLevels[TargetLevel] = false;
+		DenseLevel = FMath::Min(DenseLevel, TargetLevel - 1);
+		int32 ReasonLevel = DenseLevel;
+		for (int32 Level = TargetLevel - 1; Level > ReasonLevel; Level--)
+		{
+			if (ConflictLevels[Level])
 			{
-				(*Count)--;
-				if (*Count <= 0)
-				{
-					TileInstanceCounts.Remove(CollapsedTile);
-				}
+				ReasonLevel = Level;
+				break;
 			}
+		}
 
-			Cell->Entropy = CalculateEntropy(*Cell);
+		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Backtracked to depth %d, banning tile %d at %s"),
+		       Checkpoints.Num(), Checkpoint.TileIndex, *Grid.GetCoordinate(Checkpoint.CellIndex).ToString());
 
-			UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Uncollapsed cell %s (was tile %d)"),
-			       *LastCollapse.ToString(), CollapsedTile);
+		//该层没有选出瓦片，没有可排除的选择，只能继续回退
+		if (Checkpoint.TileIndex == INDEX_NONE)
+		{
+			continue;
+		}
+
+		if (ReasonLevel == 0)
+		{
+			BlacklistTile(Grid.GetCoordinate(Checkpoint.CellIndex), Checkpoint.TileIndex);
+		}
+
+		//禁用记录在上一层的轨迹中，再回退时一并恢复
+		const int32 BanTrailIndex = Trail.Num();
+		const bool bBanned = RemoveTileOption(Checkpoint.CellIndex, Checkpoint.TileIndex);
+		if (Trail.IsValidIndex(BanTrailIndex))
+		{
+			Trail[BanTrailIndex].ReasonLevel = ReasonLevel;
+			Trail[BanTrailIndex].bLearned = true;
 		}
+		if (bBanned && PropagateConstraints())
+		{
+			return true;
+		}
+
+		if (IsSupportCountMode())
+		{
+			PropagateSupport();
+		}
+		ClearPropagationQueue();
+		DenseLevel = FMath::Max(DenseLevel, AnalyzeConflict(ConflictLevels));
+		ConflictCells.Reset();
 	}
 
-	return true;
+	UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Backtracking exhausted after %d levels (%d total)"), Unwound, BacktrackCount);
+	return false;
+}
+
+void FWFCCore::BlacklistTile(const FWFCCoordinate& Coord, int32 TileIndex)
+{
+	BacktrackBlacklist.FindOrAdd(Coord).Add(TileIndex);
+}
+
+bool FWFCCore::IsTileBlacklisted(const FWFCCoordinate& Coord, int32 TileIndex) const
+{
+	const TSet<int32>* Tiles = BacktrackBlacklist.Find(Coord);
+	return Tiles && Tiles->Contains(TileIndex);
+}
+
+void FWFCCore::ClearBlacklistForCoordinate(const FWFCCoordinate& Coord)
+{
+	BacktrackBlacklist.Remove(Coord);
+}
+
+//之前尝试中学到的禁用与选择无关，新的尝试开始时直接移除
+bool FWFCCore::ApplyLearnedNogoods()
+{
+	for (const auto& [Coord, Tiles] : BacktrackBlacklist)
+	{
+		const int32 CellIndex = Grid.GetIndex(Coord);
+		if (CellIndex == INDEX_NONE)
+		{
+			continue;
+		}
+
+		for (const int32 TileIndex : Tiles)
+		{
+			if (!RemoveTileOption(CellIndex, TileIndex, false))
+			{
+				return false;
+			}
+		}
+	}
+
+	return PropagateConstraints();
 }
 
 bool FWFCCore::IsValidCoordinate(const FWFCCoordinate& Coord) const
 {
-	return Coord.X >= 0 && Coord.X < Config.GridSize.X &&
-		Coord.Y >= 0 && Coord.Y < Config.GridSize.Y &&
-		Coord.Z >= 0 && Coord.Z < Config.GridSize.Z;
+	return Grid.IsValidCoordinate(Coord.X, Coord.Y, Coord.Z);
 }
 
 bool FWFCCore::IsValidCoordinate(int X, int Y, int Z) const
 {
-	return X >= 0 && X < Config.GridSize.X &&
-		Y >= 0 && Y < Config.GridSize.Y &&
-		Z >= 0 && Z < Config.GridSize.Z;
+	return Grid.IsValidCoordinate(X, Y, Z);
 }
 
 bool FWFCCore::IsEdgeCoordinate(const FWFCCoordinate& Coord) const
@@ -1188,15 +2088,17 @@ bool FWFCCore::IsGroundCoordinate(const FWFCCoordinate& Coord) const
 	return Coord.Z == 1;
 }
 
-bool FWFCCore::CheckDecorators(int TileIndex, const FWFCTileDefinition& Tile, const FWFCCoordinate& Coord) const
+bool FWFCCore::CheckDecorators(int32 TileIndex, const FWFCCoordinate& Coord) const
 {
-	if (!IsGroundCoordinate(Coord) && Tile.Category == EWFCTileCategory::Ground)
+	if (!IsGroundCoordinate(Coord) && CompiledTiles->Categories[TileIndex] == EWFCTileCategory::Ground)
 	{
 		return false;
 	}
-	if (TileInstanceCounts.Contains(TileIndex) && Tile.MaxInstancesPerGeneration > 0)
+	const int32 MaxInstances = CompiledTiles->MaxInstances[TileIndex];
+	if (MaxInstances > 0)
 	{
-		if (TileInstanceCounts[TileIndex] >= Tile.MaxInstancesPerGeneration)
+		const int32* Count = TileInstanceCounts.Find(TileIndex);
+		if (Count && *Count >= MaxInstances)
 		{
 			return false;
 		}
@@ -1209,9 +2111,9 @@ bool FWFCCore::CheckCanAtEdge(const FWFCTileDefinition& Tile, const FWFCCoordina
 {
 	for (int d = 0; d < 6; d++)
 	{
-		int X = Coord.X + DirectionVectors[d].X;
-		int Y = Coord.Y + DirectionVectors[d].Y;
-		int Z = Coord.Z + DirectionVectors[d].Z;
+		int X = Coord.X + FWFCGrid::DirectionOffsets[d].X;
+		int Y = Coord.Y + FWFCGrid::DirectionOffsets[d].Y;
+		int Z = Coord.Z + FWFCGrid::DirectionOffsets[d].Z;
 		FWFCSocket CurSocket = TileSet->GetSocketDefinition(Tile.Sockets[d]);
 		if (!IsValidCoordinate(X, Y, Z) && !CurSocket.bAllowEmpty)
 		{
@@ -1224,24 +2126,17 @@ bool FWFCCore::CheckCanAtEdge(const FWFCTileDefinition& Tile, const FWFCCoordina
 
 FWFCCoordinate FWFCCore::GetNeighbor(const FWFCCoordinate& Coord, EWFCDirection Direction) const
 {
-	FIntVector Offset = DirectionVectors[static_cast<int32>(Direction)];
-	FWFCCoordinate Neighbor(Coord.X + Offset.X, Coord.Y + Offset.Y, Coord.Z + Offset.Z);
+	const int32 CellIndex = Grid.GetIndex(Coord);
+	const int32 NeighborIndex = CellIndex != INDEX_NONE
+		                            ? Grid.GetNeighborIndex(CellIndex, static_cast<int32>(Direction))
+		                            : INDEX_NONE;
 
-	// 处理周期性边界
-	if (Config.bPeriodicBoundary)
-	{
-		Neighbor.X = (Neighbor.X + Config.GridSize.X) % Config.GridSize.X;
-		Neighbor.Y = (Neighbor.Y + Config.GridSize.Y) % Config.GridSize.Y;
-		Neighbor.Z = (Neighbor.Z + Config.GridSize.Z) % Config.GridSize.Z;
-		return Neighbor;
-	}
-
-	if (!IsValidCoordinate(Neighbor))
+	if (NeighborIndex == INDEX_NONE)
 	{
 		return FWFCCoordinate(-1, -1, -1);
 	}
 
-	return Neighbor;
+	return Grid.GetCoordinate(NeighborIndex);
 }
 
 FWFCCell* FWFCCore::GetCell(const FWFCCoordinate& Coord)
@@ -1259,17 +2154,25 @@ void FWFCCore::Reset()
 	UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Resetting state"));
 
 	Grid.Empty();
-	ChangeHistory.Empty();
+	Trail.Empty();
+	Checkpoints.Empty();
+	CellTrailHead.Empty();
+	BacktrackBlacklist.Empty();
+	BacktrackCount = 0;
 	CollapseHistory.Empty();
 	TileInstanceCounts.Empty();
 	PositionConstraints.Empty();
-	PropagationRules.Empty();
-
-	while (!PropagationQueue.IsEmpty())
-	{
-		FWFCCoordinate Dummy;
-		PropagationQueue.Dequeue(Dummy);
-	}
+	AllowedScratch.Empty();
+	MaskWords = 0;
+	SelectPropagationKernels();
+	SupportCounts.Empty();
+	BanQueue.Empty();
+	CompiledTiles.Reset();
+	SelectionHeap.Empty();
+	EntropyNoise.Empty();
+	PropagationQueue.Empty();
+	QueuedCells.Empty();
+	PreparedGrid.Reset();
 }
 
 TArray<FWFCCoordinate> FWFCCore::GetNeighbors(const FWFCCoordinate& Coord) const
@@ -1288,25 +2191,11 @@ TArray<FWFCCoordinate> FWFCCore::GetNeighbors(const FWFCCoordinate& Coord) const
 	return Neighbors;
 }
 
-void FWFCCore::LogGenerationStep(const FWFCCoordinate& Coord, int32 TileIndex) const
-{
-	if (TileSet)
-	{
-		FWFCTileDefinition TileDef = TileSet->GetTile(TileIndex);
-		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Collapsed %s to tile %d (%s)"),
-		       *Coord.ToString(), TileIndex, *TileDef.TileName);
-	}
-	else
-	{
-		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Collapsed %s to tile %d"),
-		       *Coord.ToString(), TileIndex);
-	}
-}
-
-void FWFCCore::LogPropagationStep(const FWFCCoordinate& From, const FWFCCoordinate& To, int32 RemovedTile) const
+void FWFCCore::LogGenerationStep(int32 CellIndex, int32 TileIndex) const
 {
-	UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Propagation %s -> %s removed tile %d"),
-	       *From.ToString(), *To.ToString(), RemovedTile);
+	//可能在工作线程上调用，只记录下标，不读取TileSet里的名字
+	UE_LOG(LogTemp, VeryVerbose, TEXT("WFCCore: Collapsed %s to tile %d"),
+	       *Grid.GetCoordinate(CellIndex).ToString(), TileIndex);
 }
 
 FString FWFCCore::GetGridStateString() const
@@ -1315,9 +2204,9 @@ FString FWFCCore::GetGridStateString() const
 	int32 CollapsedCount = 0;
 	int32 TotalCells = Grid.Num();
 
-	for (const auto& [Coord, Cell] : Grid)
+	for (int32 CellIndex = 0; CellIndex < TotalCells; CellIndex++)
 	{
-		if (Cell.IsCollapsed())
+		if (Grid[CellIndex].IsCollapsed())
 		{
 			CollapsedCount++;
 		}
@@ -1331,9 +2220,25 @@ FString FWFCCore::GetGridStateString() const
 }
 
 
+SIZE_T FWFCCore::GetAllocatedSize() const
+{
+	SIZE_T Bytes = Grid.GetAllocatedSize() + SupportCounts.GetAllocatedSize() + BanQueue.GetAllocatedSize() +
+		AllowedScratch.GetAllocatedSize() + SelectionHeap.GetAllocatedSize() + EntropyNoise.GetAllocatedSize() +
+		PropagationQueue.GetAllocatedSize() + QueuedCells.GetAllocatedSize() + Trail.GetAllocatedSize() +
+		Checkpoints.GetAllocatedSize() + CellTrailHead.GetAllocatedSize() + CollapseHistory.GetAllocatedSize();
+	if (PreparedGrid)
+	{
+		Bytes += PreparedGrid->Grid.GetAllocatedSize() + PreparedGrid->SupportCounts.GetAllocatedSize() +
+			PreparedGrid->CollapseHistory.GetAllocatedSize();
+	}
+	return Bytes;
+}
+
 void FWFCCore::SetPreProcessCache(UWFCPreProcessCache* InCache)
 {
 	PreProcessCache = InCache;
+	PreparedGrid.Reset();
+	BacktrackBlacklist.Empty();
 }
 
 
@@ -1344,40 +2249,58 @@ bool FWFCCore::LoadPreProcessedGrid()
 		return false;
 	}
 
-	FWFCPreProcessCacheData CacheData;
-	if (PreProcessCache->GetCacheForGridSize(Config.GridSize, CacheData))
-	{
-		ApplyCachedGrid(CacheData);
-		return true;
-	}
-
-	return false;
+	TSharedPtr<const FWFCPackedGridCache> PackedGrid = PreProcessCache->FindPackedGrid(Config.GridSize);
+	return PackedGrid && ApplyCachedGrid(*PackedGrid);
 }
 
-void FWFCCore::ApplyCachedGrid(const FWFCPreProcessCacheData& CacheData)
+bool FWFCCore::ApplyCachedGrid(const FWFCPackedGridCache& PackedGrid)
 {
-	Grid.Empty();
-	TileInstanceCounts = CacheData.CachedTileInstanceCounts;
-	CollapseHistory = CacheData.CachedCollapseHistory;
+	if (PackedGrid.TileCount != CompiledTiles->NumTiles || PackedGrid.GridSize != Config.GridSize)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Cached grid %s does not match current tile set, ignoring cache"),
+			   *PackedGrid.GridSize.ToString());
+		return false;
+	}
+
+	//缓存只在准备快照时读取一次，网格已由InitializeGrid按相同尺寸分配，位集整块拷贝
+	if (Grid.GetSize() != Config.GridSize || Grid.GetTileCount() != PackedGrid.TileCount)
+	{
+		Grid.Init(Config.GridSize, Config.bPeriodicBoundary, PackedGrid.TileCount);
+	}
+	if (PackedGrid.WordsPerCell != Grid.GetWordsPerCell() ||
+		PackedGrid.PossibleWords.Num() != Grid.Num() * Grid.GetWordsPerCell())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WFCCore: Cached grid %s has a malformed tile block, ignoring cache"),
+			   *PackedGrid.GridSize.ToString());
+		return false;
+	}
+	FMemory::Memcpy(Grid.GetTileWords(0), PackedGrid.PossibleWords.GetData(), PackedGrid.PossibleWords.Num() * sizeof(uint64));
 
-	for (const auto& [Coord, CachedCell] : CacheData.CachedGrid)
+	TileInstanceCounts.Empty();
+	CollapseHistory.Reset(PackedGrid.CollapseHistory.Num());
+	for (int32 CellIndex = 0; CellIndex < Grid.Num(); CellIndex++)
 	{
-		FWFCCell& Cell = Grid.Add(Coord, FWFCCell(TileSet->GetTileCount()));
-        
-		Cell.PossibleTiles.SetNum(CachedCell.PossibleTiles.Num(), false);
-		for (int32 i = 0; i < CachedCell.PossibleTiles.Num(); i++)
+		FWFCCell& Cell = Grid[CellIndex];
+		Cell.bCollapsed = PackedGrid.IsCollapsed(CellIndex);
+		Cell.CollapsedTileIndex = Cell.bCollapsed ? Grid.FindFirstPossibleTile(CellIndex) : -1;
+		if (Cell.bCollapsed)
 		{
-			Cell.PossibleTiles[i] = CachedCell.PossibleTiles[i];
+			TileInstanceCounts.FindOrAdd(Cell.CollapsedTileIndex, 0)++;
 		}
-        
-		Cell.bCollapsed = CachedCell.bCollapsed;
-		Cell.CollapsedTileIndex = CachedCell.CollapsedTileIndex;
-		Cell.Entropy = CachedCell.Entropy;
+		RecalculateCellWeights(CellIndex);
+		Cell.Entropy = CalculateEntropy(Cell);
+	}
+
+	for (const int32 CellIndex : PackedGrid.CollapseHistory)
+	{
+		CollapseHistory.Add(Grid.GetCoordinate(CellIndex));
 	}
 
-	while (!PropagationQueue.IsEmpty())
+	ClearPropagationQueue();
+	RebuildSelectionHeap();
+	if (IsSupportCountMode())
 	{
-		FWFCCoordinate Dummy;
-		PropagationQueue.Dequeue(Dummy);
+		RebuildSupportCounts();
 	}
-}
\ No newline at end of file
+	return true;
+}
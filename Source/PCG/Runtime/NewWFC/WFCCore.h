@@ -5,34 +5,59 @@
 #include "CoreMinimal.h"
 #include "WFCTypes.h"
 #include "WFCTileSet.h"
+#include "WFCGrid.h"
+#include "WFCEntropyHeap.h"
+#include "WFCCompiledTileSet.h"
+#include "WFCReplay.h"
+#include "Containers/CircularQueue.h"
 
-struct FWFCPreProcessCacheData;
+struct FWFCPackedGridCache;
 class UWFCPreProcessCache;
 DECLARE_DELEGATE_TwoParams(FOnWFCStatusUpdate, FWFCCoordinate, int32);
 
-struct FWFCCell
+//回溯轨迹项：TileIndex为INDEX_NONE时表示该格子被坍缩，否则表示移除了该瓦片
+struct FWFCTrailEntry
 {
-    FWFCCell() = default;
-    FWFCCell(int32 TileCount) : PossibleTiles(false, TileCount) {}
-    
-    TBitArray<> PossibleTiles;    
-    bool bCollapsed = false;      
-    int32 CollapsedTileIndex = -1;  
-    float Entropy = 0.0f;      
-    
-    int32 GetPossibleTileCount() const { return PossibleTiles.CountSetBits(); }
-    bool IsCollapsed() const { return bCollapsed; }
-    bool CanPlace(int32 TileIndex) const { return PossibleTiles[TileIndex]; }
+    int32 CellIndex;
+    int32 TileIndex;
+    //同一格子上一条轨迹项的下标，冲突分析时按格子回溯
+    int32 PrevForCell;
+    //移除原因：来源格子；为INDEX_NONE时是ReasonLevel层的选择本身
+    int32 ReasonCell;
+    int32 ReasonLevel;
+    //回溯中学到的禁用，保守地视为依赖ReasonLevel及以下所有层
+    bool bLearned;
 };
 
-struct FWFCChange
+//每次选择前的检查点，回溯时把轨迹截断到TrailSize并禁用本次选择的瓦片
+struct FWFCCheckpoint
 {
-    FWFCCoordinate Position;
+    int32 TrailSize;
+    int32 CollapseHistorySize;
+    int32 CellIndex;
     int32 TileIndex;
-    bool bWasRemoved;
-    
-    FWFCChange(const FWFCCoordinate& Pos, int32 Tile, bool Removed)
-        : Position(Pos), TileIndex(Tile), bWasRemoved(Removed) {}
+};
+
+struct FWFCBan
+{
+    int32 CellIndex;
+    int32 TileIndex;
+};
+
+//坍缩事件，求解线程写入环形缓冲，游戏线程按帧批量取出
+struct FWFCStatusEvent
+{
+    FWFCCoordinate Coord;
+    int32 TileIndex;
+};
+
+//预处理后的初始状态，生成后只读，重试和并行尝试之间共享
+struct FWFCPreparedGrid
+{
+    FWFCGrid Grid;
+    TArray<int32> SupportCounts;
+    TArray<FWFCCoordinate> CollapseHistory;
+    TMap<int32, int32> TileInstanceCounts;
 };
 
 class PCG_API FWFCCore
@@ -47,81 +72,211 @@ public:
     
     void Reset();
 
-    const TMap<FWFCCoordinate, FWFCCell>& GetGrid() const { return Grid; }
+    const FWFCGrid& GetGrid() const { return Grid; }
     FWFCCell* GetCell(const FWFCCoordinate& Coord);
     const FWFCCell* GetCell(const FWFCCoordinate& Coord) const;
     TArray<FWFCCoordinate> GetCollapseHistory() {return CollapseHistory;}
+    const FWFCSolverStats& GetStats() const { return Stats; }
+    //求解器自身持有的网格、支持数、回溯记录和预处理快照，不含共享的编译瓦片集
+    SIZE_T GetAllocatedSize() const;
+    TSharedPtr<const FWFCCompiledTileSet> GetCompiledTileSet() const { return CompiledTiles; }
+
+    //返回true时中止正在进行的生成循环
+    void SetCancellationCheck(TFunction<bool()> InCancellationCheck) { CancellationCheck = MoveTemp(InCancellationCheck); }
+    bool IsCancelled() const { return CancellationCheck && CancellationCheck(); }
 
     FOnWFCStatusUpdate OnStatusUpdate;
+
+    //游戏线程调用，且不能与生成同时进行。分配单生产者单消费者环形缓冲，容量为格子数的两倍，满时丢弃事件
+    //之后Initialize或UpdateGrid扩大网格时缓冲随之扩容
+    void EnableStatusEvents();
+    //游戏线程每帧调用一次，对缓冲中的事件逐个执行OnStatusUpdate，返回处理的数量
+    int32 DrainStatusEvents(int32 MaxEvents = MAX_int32);
+    int32 GetDroppedStatusEventCount() const { return DroppedStatusEvents.load(std::memory_order_relaxed); }
+
+    //开启后每次Generate记录起始随机流状态、各尝试的种子和每次随机选择
+    void SetReplayRecording(bool bEnable) { bRecordReplay = bEnable; }
+    const FWFCReplayLog& GetReplayLog() const { return ReplayLog; }
+    //按日志的配置和随机流状态重新生成，决策序列和结果都与日志一致时返回true
+    bool ReplayGeneration(UWFCTileSet* InTileSet, const FWFCReplayLog& Log, FWFCGenerationResult& OutResult);
 private:
+    void PostStatusEvent(const FWFCCoordinate& Coord, int32 TileIndex)
+    {
+        if (StatusEventTarget)
+        {
+            StatusEventTarget->PostForwardedStatusEvent(Coord, TileIndex);
+        }
+        else if (StatusEvents && !StatusEvents->Enqueue({Coord, TileIndex}))
+        {
+            DroppedStatusEvents.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    //并行尝试和分块可能同时转发，加锁保持缓冲单生产者；子求解器运行期间父求解器自身不产生事件
+    void PostForwardedStatusEvent(const FWFCCoordinate& Coord, int32 TileIndex);
+    void ResizeStatusEvents();
+
+    TUniquePtr<TCircularQueue<FWFCStatusEvent>> StatusEvents;
+    uint32 StatusEventCapacity = 0;
+    std::atomic<int32> DroppedStatusEvents{0};
+    //并行尝试的子求解器把事件转发给父求解器
+    FWFCCore* StatusEventTarget = nullptr;
+    FCriticalSection StatusForwardLock;
+
+    //子求解器沿用父求解器已校验、已编译的瓦片数据，不重新访问UObject，网格由各自的尝试填充
+    void InitializeFrom(const FWFCCore& Parent, const FWFCConfiguration& InConfig);
+    bool RunAttempt(int32 AttemptSeed);
+    void PrepareGrid();
+    void RestorePreparedGrid();
+    bool CanGenerateChunked() const;
+    bool RunAttemptWithFixedCells(const TArray<TPair<int32, int32>>& SeamCells, const TArray<int32>& BoundaryCells);
+    FWFCGenerationResult GenerateParallel(int32 GenerationSeed);
+    FWFCGenerationResult GenerateChunked();
+    FWFCGenerationResult MakeResult(bool bSuccess, double StartTime) const;
+    //第0次尝试直接使用GenerationSeed，之后的尝试与并行尝试按编号派生
+    static int32 GetAttemptSeed(int32 GenerationSeed, int32 AttemptIndex);
+    void BeginReplayLog(int32 GenerationSeed);
+    uint32 ComputeResultHash() const;
+
+    TFunction<bool()> CancellationCheck;
+    TSharedPtr<const FWFCPreparedGrid> PreparedGrid;
+    FWFCSolverStats Stats;
+    bool bRecordReplay = false;
+    FWFCReplayLog ReplayLog;
+
     UWFCTileSet* TileSet = nullptr;
     FWFCConfiguration Config;
-    TMap<FWFCCoordinate, FWFCCell> Grid;
+    FWFCGrid Grid;
     FRandomStream RandomGenerator;
     
-    TArray<TArray<TArray<int32>>> PropagationRules; 
-    TQueue<FWFCCoordinate> PropagationQueue;
+    //按内容共享的只读编译数据，包含兼容掩码与初始支持数
+    TSharedPtr<const FWFCCompiledTileSet> CompiledTiles;
+    int32 MaskWords = 0;
+    TArray<uint64> AllowedScratch;
+    //AC-4：SupportCounts[(Cell * TileCount + Tile) * 6 + Dir]为Dir方向邻居中仍兼容该瓦片的数量
+    TArray<int32> SupportCounts;
+    TArray<FWFCBan> BanQueue;
+
+    //传播内核按掩码字数编译，NumWords为0时是按MaskWords循环的通用版本，Initialize时按瓦片数选择
+    template <int32 NumWords>
+    bool PropagateFromWords(int32 CellIndex);
+    template <int32 NumWords>
+    bool PropagateSupportWords();
+    void SelectPropagationKernels();
+    bool (FWFCCore::*PropagateFromKernel)(int32) = nullptr;
+    bool (FWFCCore::*PropagateSupportKernel)() = nullptr;
+
+    FWFCEntropyHeap SelectionHeap;
+    TArray<float> EntropyNoise;
+    TArray<int32> PropagationQueue;
+    TBitArray<> QueuedCells;
     
-    TArray<TArray<FWFCChange>> ChangeHistory; 
+    TArray<FWFCTrailEntry> Trail;
+    TArray<FWFCCheckpoint> Checkpoints;
+    TArray<int32> CellTrailHead;
+    int32 BacktrackCount = 0;
+    //最近一次矛盾涉及的格子，用于回跳时分析冲突集
+    TArray<int32, TInlineAllocator<4>> ConflictCells;
     TArray<FWFCCoordinate> CollapseHistory; 
     
     TMap<FWFCCoordinate, TArray<int32>> PositionConstraints;
     TMap<int32, int32> TileInstanceCounts;
     TMap<FWFCCoordinate, TSet<int32>> BacktrackBlacklist;
-    static const TArray<FIntVector> DirectionVectors;
 
 public:
     void InitializeGrid();
-    void BuildPropagationRules();
-    void ValidatePropagationRules();
+    void InitializeEntropyNoise();
     void ApplyConstraints();
     void CellPreProcess();
+    bool CollapseBoundaryCells(const TArray<int32>& BoundaryCells);
     
     bool RunGenerationLoop();
-    FWFCCoordinate SelectNextCell();
+    int32 SelectNextCell();
     bool CollapseCell(const FWFCCoordinate& Coord);
+    bool CollapseCell(int32 CellIndex);
     bool CollapseCellTo(const FWFCCoordinate& Coord, int32 TileIndex);
+    bool CollapseCellTo(int32 CellIndex, int32 TileIndex);
     bool PropagateConstraints();
     
-    FWFCCoordinate SelectCellRandom();
-    FWFCCoordinate SelectCellGroundFirst();
-    FWFCCoordinate SelectCellLayered();
-    FWFCCoordinate SelectCellCenterOut();
+    FWFCEntropyHeap::FKey GetSelectionKey(int32 CellIndex) const;
+    void UpdateCellSelection(int32 CellIndex);
+    void RebuildSelectionHeap();
     
     void QueuePropagation(const FWFCCoordinate& Coord);
+    void QueuePropagation(int32 CellIndex);
+    void ClearPropagationQueue();
     bool PropagateFrom(const FWFCCoordinate& Coord);
+    bool PropagateFrom(int32 CellIndex) { return (this->*PropagateFromKernel)(CellIndex); }
     bool RemoveTileOption(const FWFCCoordinate& Coord, int32 TileIndex, bool bTrackChanges = true);
+    bool RemoveTileOption(int32 CellIndex, int32 TileIndex, bool bTrackChanges = true, int32 ReasonCell = INDEX_NONE);
+    bool OnTileOptionsRemoved(int32 CellIndex, int32 LastRemovedTile);
+    bool IsSupportCountMode() const { return Config.PropagatorMode == EWFCPropagatorMode::SupportCount; }
+    void InitializeSupportCounts();
+    void BanUnsupportedTiles();
+    void RebuildSupportCounts();
+    bool PropagateSupport() { return (this->*PropagateSupportKernel)(); }
+    void RestoreSupport(int32 CellIndex, int32 TileIndex);
+    void BanCollapsedAlternatives(int32 CellIndex, int32 KeepTile);
+    const uint64* GetCompatibilityMask(int32 Direction, int32 TileIndex) const
+    {
+        return CompiledTiles->GetCompatibilityMask(Direction, TileIndex);
+    }
     
     bool CanBacktrack() const;
     bool Backtrack();
-    void SaveState();
+    void SaveState(int32 CellIndex);
+    void RecordTrail(int32 CellIndex, int32 TileIndex, int32 ReasonCell = INDEX_NONE)
+    {
+        if (Checkpoints.Num() > 0)
+        {
+            Trail.Add({CellIndex, TileIndex, CellTrailHead[CellIndex], ReasonCell, Checkpoints.Num(), false});
+            CellTrailHead[CellIndex] = Trail.Num() - 1;
+        }
+    }
+    //只记录第一个矛盾涉及的格子，AC-4出现矛盾后仍会处理完队列
+    void RecordConflict(int32 CellA, int32 CellB = INDEX_NONE)
+    {
+        if (ConflictCells.Num() == 0)
+        {
+            ConflictCells.Add(CellA);
+            if (CellB != INDEX_NONE)
+            {
+                ConflictCells.Add(CellB);
+            }
+        }
+    }
+    void UndoTrail(int32 ToSize);
+    int32 AnalyzeConflict(TBitArray<>& OutLevels) const;
+    bool ApplyLearnedNogoods();
     
     bool IsValidCoordinate(const FWFCCoordinate& Coord) const;
     bool IsValidCoordinate(int X, int Y, int Z) const;
     bool IsEdgeCoordinate(const FWFCCoordinate& Coord) const;
     bool IsBoundaryCoordinate(const FWFCCoordinate& Coord) const;
     bool IsGroundCoordinate(const FWFCCoordinate& Coord) const;
-    bool CheckDecorators(int TileIndex, const FWFCTileDefinition& Tile, const FWFCCoordinate& Coord) const;
+    bool CheckDecorators(int32 TileIndex, const FWFCCoordinate& Coord) const;
     bool CheckCanAtEdge(const FWFCTileDefinition& Tile, const FWFCCoordinate& Coord) const;
     FWFCCoordinate GetNeighbor(const FWFCCoordinate& Coord, EWFCDirection Direction) const;
     TArray<FWFCCoordinate> GetNeighbors(const FWFCCoordinate& Coord) const;
     
     float CalculateEntropy(const FWFCCell& Cell) const;
-    int32 SelectRandomTile(const FWFCCell& Cell, const FWFCCoordinate& Coord);
+    void AddTileWeight(FWFCCell& Cell, int32 TileIndex) const;
+    void RemoveTileWeight(FWFCCell& Cell, int32 TileIndex) const;
+    void RecalculateCellWeights(int32 CellIndex);
+    int32 SelectRandomTile(int32 CellIndex, const FWFCCoordinate& Coord);
     
-    bool CheckConstraints(const FWFCCoordinate& Coord, int32 TileIndex) const;
+    bool CheckConstraints(int32 CellIndex, int32 TileIndex) const;
     bool CheckInstanceLimits(int32 TileIndex) const;
-    bool CheckSupportRequirement(const FWFCCoordinate& Coord, int32 TileIndex) const;
+    bool CheckSupportRequirement(int32 CellIndex, int32 TileIndex) const;
     
-    void LogGenerationStep(const FWFCCoordinate& Coord, int32 TileIndex) const;
-    void LogPropagationStep(const FWFCCoordinate& From, const FWFCCoordinate& To, int32 RemovedTile) const;
+    void LogGenerationStep(int32 CellIndex, int32 TileIndex) const;
     FString GetGridStateString() const;
 
 
     void RestoreState(int32 ToDepth);
-        void BlacklistTile(const FWFCCoordinate& Coord, int32 TileIndex);
-        bool IsTileBlacklisted(const FWFCCoordinate& Coord, int32 TileIndex) const;
-        void ClearBlacklistForCoordinate(const FWFCCoordinate& Coord);
+    //与任何选择都无关的禁用，对同一配置的后续尝试同样成立
+    void BlacklistTile(const FWFCCoordinate& Coord, int32 TileIndex);
+    bool IsTileBlacklisted(const FWFCCoordinate& Coord, int32 TileIndex) const;
+    void ClearBlacklistForCoordinate(const FWFCCoordinate& Coord);
 
     //尝试使用Cache
 public:
@@ -132,5 +287,5 @@ private:
     UPROPERTY()
     TObjectPtr<UWFCPreProcessCache> PreProcessCache;
     
-    void ApplyCachedGrid(const FWFCPreProcessCacheData& CacheData);
+    bool ApplyCachedGrid(const FWFCPackedGridCache& PackedGrid);
 };
\ No newline at end of file
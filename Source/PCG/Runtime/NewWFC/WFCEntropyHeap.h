@@ -0,0 +1,140 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//按格子下标索引的最小堆，先比较Priority（生成模式决定的层级），再比较熵
+class FWFCEntropyHeap
+{
+public:
+    struct FKey
+    {
+        int32 Priority = 0;
+        float Entropy = 0.0f;
+
+        bool operator<(const FKey& Other) const
+        {
+            return Priority != Other.Priority ? Priority < Other.Priority : Entropy < Other.Entropy;
+        }
+    };
+
+    void Init(int32 NumCells)
+    {
+        Heap.Reset(NumCells);
+        Keys.SetNumUninitialized(NumCells);
+        Positions.Init(INDEX_NONE, NumCells);
+    }
+
+    void Empty()
+    {
+        Heap.Empty();
+        Keys.Empty();
+        Positions.Empty();
+    }
+
+    bool IsEmpty() const { return Heap.Num() == 0; }
+    int32 Num() const { return Heap.Num(); }
+    SIZE_T GetAllocatedSize() const { return Heap.GetAllocatedSize() + Keys.GetAllocatedSize() + Positions.GetAllocatedSize(); }
+    bool Contains(int32 CellIndex) const { return Positions[CellIndex] != INDEX_NONE; }
+    int32 Top() const { return Heap.Num() > 0 ? Heap[0] : INDEX_NONE; }
+
+    //不在堆中则插入，否则按新键上浮或下沉
+    void Update(int32 CellIndex, const FKey& Key)
+    {
+        int32 Position = Positions[CellIndex];
+        if (Position == INDEX_NONE)
+        {
+            Keys[CellIndex] = Key;
+            Position = Heap.Add(CellIndex);
+            Positions[CellIndex] = Position;
+            SiftUp(Position);
+            return;
+        }
+
+        const bool bDecreased = Key < Keys[CellIndex];
+        Keys[CellIndex] = Key;
+        if (bDecreased)
+        {
+            SiftUp(Position);
+        }
+        else
+        {
+            SiftDown(Position);
+        }
+    }
+
+    void Remove(int32 CellIndex)
+    {
+        const int32 Position = Positions[CellIndex];
+        if (Position == INDEX_NONE)
+        {
+            return;
+        }
+
+        const int32 LastPosition = Heap.Num() - 1;
+        if (Position != LastPosition)
+        {
+            SwapEntries(Position, LastPosition);
+        }
+        Heap.Pop(EAllowShrinking::No);
+        Positions[CellIndex] = INDEX_NONE;
+
+        if (Position < Heap.Num())
+        {
+            SiftUp(Position);
+            SiftDown(Position);
+        }
+    }
+
+private:
+    void SiftUp(int32 Position)
+    {
+        while (Position > 0)
+        {
+            const int32 Parent = (Position - 1) / 2;
+            if (!(Keys[Heap[Position]] < Keys[Heap[Parent]]))
+            {
+                break;
+            }
+            SwapEntries(Position, Parent);
+            Position = Parent;
+        }
+    }
+
+    void SiftDown(int32 Position)
+    {
+        const int32 Count = Heap.Num();
+        while (true)
+        {
+            const int32 Left = Position * 2 + 1;
+            const int32 Right = Left + 1;
+            int32 Smallest = Position;
+            if (Left < Count && Keys[Heap[Left]] < Keys[Heap[Smallest]])
+            {
+                Smallest = Left;
+            }
+            if (Right < Count && Keys[Heap[Right]] < Keys[Heap[Smallest]])
+            {
+                Smallest = Right;
+            }
+            if (Smallest == Position)
+            {
+                break;
+            }
+            SwapEntries(Position, Smallest);
+            Position = Smallest;
+        }
+    }
+
+    void SwapEntries(int32 A, int32 B)
+    {
+        Swap(Heap[A], Heap[B]);
+        Positions[Heap[A]] = A;
+        Positions[Heap[B]] = B;
+    }
+
+    TArray<int32> Heap;
+    TArray<FKey> Keys;
+    TArray<int32> Positions;
+};
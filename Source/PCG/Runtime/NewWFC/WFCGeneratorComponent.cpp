@@ -4,10 +4,25 @@
 #include "Engine/World.h"
 #include "Engine/Engine.h"
 #include "Components/StaticMeshComponent.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
 #include "Async/Async.h"
 #include "Kismet/KismetSystemLibrary.h"
 #include "PCG/Runtime/DebugHelper.h"
 
+namespace
+{
+	FWFCGenerationResult GenerateWithReplay(FWFCCore& Core, bool bRecordReplay, float SaveThresholdSeconds)
+	{
+		Core.SetReplayRecording(bRecordReplay);
+		FWFCGenerationResult Result = Core.Generate();
+		if (bRecordReplay && (!Result.bSuccess || Result.GenerationTimeSeconds >= SaveThresholdSeconds))
+		{
+			Core.GetReplayLog().SaveToFile(FWFCReplayLog::CreateReplayPath());
+		}
+		return Result;
+	}
+}
+
 UWFCGeneratorComponent::UWFCGeneratorComponent()
 {
 	PrimaryComponentTick.bCanEverTick = true;
@@ -16,7 +31,7 @@ UWFCGeneratorComponent::UWFCGeneratorComponent()
 	Configuration.GenerationMode = EWFCGenerationMode::GroundFirst;
 	Configuration.MaxIterations = 1000;
 	Configuration.bEnableBacktracking = true;
-	Configuration.BacktrackingDepth = 10;
+	Configuration.BacktrackingDepth = 100;
 }
 
 void UWFCGeneratorComponent::BeginPlay()
@@ -46,12 +61,25 @@ void UWFCGeneratorComponent::TickComponent(float DeltaTime, enum ELevelTick Tick
 	FActorComponentTickFunction* ThisTickFunction)
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
-	
+
+	//坍缩事件每帧批量处理一次，队列请求的事件在各自求解器的缓冲中
+	if (WFCCore)
+	{
+		WFCCore->DrainStatusEvents();
+	}
+	for (FGenerationWorker& Worker : GenerationWorkers)
+	{
+		if (Worker.Core)
+		{
+			Worker.Core->DrainStatusEvents();
+		}
+	}
 }
 
 void UWFCGeneratorComponent::BeginDestroy()
 {
-	bShouldStopProcessing.store(true);
+	StopProcessingFlag->store(true);
+	CancelGenerationWorkers();
 	ClearQueue();
 	Super::BeginDestroy();
 }
@@ -90,6 +118,9 @@ void UWFCGeneratorComponent::InitializeWFCCore(const FWFCConfiguration& CustomCo
 	}
 
 	WFCCore->OnStatusUpdate.BindUObject(this, &UWFCGeneratorComponent::OnWFCStatusUpdate);
+	ResetWorkerPool();
+	//回溯会重复坍缩同一格子，预留两倍格子数
+	WFCCore->EnableStatusEvents();
 }
 
 void UWFCGeneratorComponent::StartGeneration()
@@ -153,111 +184,361 @@ void UWFCGeneratorComponent::StartGenerationWithCustomConfigAt(FVector Location,
 
 int UWFCGeneratorComponent::ExecuteGenerationAsyncAt(FVector Location, FRotator Rotation)
 {
-	if (bShouldStopProcessing.load())
+	return EnqueueRequest(Location, Rotation, EWFCRequestPriority::Normal, true);
+}
+
+int UWFCGeneratorComponent::QueueGeneration(FVector Location, FRotator Rotation)
+{
+	return EnqueueRequest(Location, Rotation, EWFCRequestPriority::Normal, false);
+}
+
+int UWFCGeneratorComponent::QueueGenerationWithPriority(FVector Location, FRotator Rotation,
+                                                        EWFCRequestPriority Priority)
+{
+	return EnqueueRequest(Location, Rotation, Priority, true);
+}
+
+int UWFCGeneratorComponent::EnqueueRequest(FVector Location, FRotator Rotation, EWFCRequestPriority Priority,
+                                           bool bRespectQueueLimit)
+{
+	if (StopProcessingFlag->load())
 	{
 		UE_LOG(LogTemp, Warning, TEXT("WFCGenerator: Component is being destroyed, ignoring request"));
 		return 0;
 	}
 
-	if (GetQueueSize() >= MaxQueueSize)
+	int RequestId = 0;
+	int32 QueueSize = 0;
 	{
-		UE_LOG(LogTemp, Warning, TEXT("WFCGenerator: Queue is full (%d), ignoring new request"), MaxQueueSize);
-		return 0;
+		FScopeLock Lock(&QueueLock);
+		FGenerationRequest* Existing = PendingRequests.FindByPredicate([&Location](const FGenerationRequest& Pending)
+		{
+			return Pending.Location.Equals(Location);
+		});
+
+		if (Existing)
+		{
+			//同一位置只保留一个等待中的请求，使用最新的朝向和较高的优先级
+			Existing->Rotation = Rotation;
+			Existing->Priority = FMath::Max(Existing->Priority, Priority);
+			RequestId = Existing->RequestId;
+		}
+		else
+		{
+			if (bRespectQueueLimit && PendingRequests.Num() >= MaxQueueSize)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("WFCGenerator: Queue is full (%d), ignoring new request"), MaxQueueSize);
+				return 0;
+			}
+			RequestId = NextRequestId.fetch_add(1);
+			PendingRequests.Emplace(Location, Rotation, RequestId, Priority);
+		}
+		QueueSize = PendingRequests.Num();
 	}
 
-	uint32 RequestId = NextRequestId.fetch_add(1);
-	FGenerationRequest Request(Location, Rotation, RequestId);
-	
-	PendingRequests.Add(Request);
-	
-	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Queued generation request %d at location %s (Queue size: %d)"), 
-	       RequestId, *Location.ToString(), GetQueueSize());
+	//正在运行的同位置请求结果已过时
+	for (FGenerationWorker& Worker : GenerationWorkers)
+	{
+		if (Worker.bBusy && Worker.Request.RequestId != RequestId && Worker.Request.Location.Equals(Location))
+		{
+			Worker.Request.CancelToken->store(true);
+			UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Request %d superseded by request %d"),
+			       Worker.Request.RequestId, RequestId);
+		}
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Queued generation request %d at location %s (Queue size: %d)"),
+	       RequestId, *Location.ToString(), QueueSize);
 
-	if (!bIsProcessingQueue)
+	//异步模式下每个新请求都尝试派发，没有空闲求解器时留在队列中；同步模式由正在处理的循环继续
+	if (bUseAsyncGeneration || !bIsProcessingQueue)
 	{
 		ProcessNextRequest();
 	}
-	
+
 	return RequestId;
 }
 
-int UWFCGeneratorComponent::QueueGeneration(FVector Location, FRotator Rotation)
+bool UWFCGeneratorComponent::PopNextRequest(FGenerationRequest& OutRequest)
 {
-	uint32 RequestId = NextRequestId.fetch_add(1);
-	FGenerationRequest Request(Location, Rotation, RequestId);
-	
-	PendingRequests.Add(Request);
+	FScopeLock Lock(&QueueLock);
+	if (PendingRequests.Num() == 0)
+	{
+		return false;
+	}
 
-	if (!bIsProcessingQueue)
+	//优先级高的先处理，同优先级按提交顺序
+	int32 BestIndex = 0;
+	for (int32 i = 1; i < PendingRequests.Num(); i++)
 	{
-		ProcessNextRequest();
+		const FGenerationRequest& Candidate = PendingRequests[i];
+		const FGenerationRequest& Best = PendingRequests[BestIndex];
+		if (Candidate.Priority > Best.Priority ||
+			(Candidate.Priority == Best.Priority && Candidate.RequestId < Best.RequestId))
+		{
+			BestIndex = i;
+		}
 	}
-	
-	return RequestId;
+
+	OutRequest = PendingRequests[BestIndex];
+	PendingRequests.RemoveAt(BestIndex);
+	return true;
 }
 
-void UWFCGeneratorComponent::ProcessNextRequest()
+bool UWFCGeneratorComponent::CancelRequest(int RequestId)
 {
-	FGenerationRequest Request;
-	if (PendingRequests.Num() == 0)
 	{
-		bIsProcessingQueue = false;
-		UE_LOG(LogTemp, VeryVerbose, TEXT("WFCGenerator: Queue is empty, stopping processing"));
-		return;
+		FScopeLock Lock(&QueueLock);
+		const int32 PendingIndex = PendingRequests.IndexOfByPredicate([RequestId](const FGenerationRequest& Pending)
+		{
+			return Pending.RequestId == RequestId;
+		});
+		if (PendingIndex != INDEX_NONE)
+		{
+			PendingRequests.RemoveAt(PendingIndex);
+			UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Cancelled queued request %d"), RequestId);
+			return true;
+		}
+	}
+
+	for (FGenerationWorker& Worker : GenerationWorkers)
+	{
+		if (Worker.bBusy && Worker.Request.RequestId == RequestId)
+		{
+			Worker.Request.CancelToken->store(true);
+			UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Cancelling running request %d"), RequestId);
+			return true;
+		}
 	}
-	Request = PendingRequests.Pop();
 
-	if (bShouldStopProcessing.load())
+	return false;
+}
+
+void UWFCGeneratorComponent::ProcessNextRequest()
+{
+	if (StopProcessingFlag->load())
 	{
-		bIsProcessingQueue = false;
+		bIsProcessingQueue = HasBusyWorkers();
 		return;
 	}
 
-	bIsProcessingQueue = true;
-	
-	if (!WFCCore)
+	if (!bUseAsyncGeneration)
 	{
-		UE_LOG(LogTemp, Error, TEXT("WFCGenerator: WFC Core not initialized for request %d"), Request.RequestId);
-		bIsProcessingQueue = false;
+		FGenerationRequest Request;
+		if (!PopNextRequest(Request))
+		{
+			bIsProcessingQueue = false;
+			UE_LOG(LogTemp, VeryVerbose, TEXT("WFCGenerator: Queue is empty, stopping processing"));
+			return;
+		}
+		bIsProcessingQueue = true;
+
+		if (!WFCCore)
+		{
+			UE_LOG(LogTemp, Error, TEXT("WFCGenerator: WFC Core not initialized for request %d"), Request.RequestId);
+			bIsProcessingQueue = false;
+			ProcessNextRequest();
+			return;
+		}
+
+		WFCCore->UpdateGrid(Configuration);
+		UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Processing queued request %d"), Request.RequestId);
+
+		FWFCGenerationResult Result = GenerateWithReplay(*WFCCore, bRecordReplays, ReplaySaveThresholdSeconds);
+		OnGenerationFinished(Result, Request.Location, Request.Rotation, WFCCore->GetCollapseHistory());
 		ProcessNextRequest();
 		return;
 	}
 
-	WFCCore->UpdateGrid(Configuration);
+	//有空闲求解器就继续派发，结果在游戏线程按派发顺序交付
+	while (GetQueueSize() > 0)
+	{
+		const int32 WorkerIndex = FindIdleWorker();
+		FGenerationRequest Request;
+		if (WorkerIndex == INDEX_NONE || !PopNextRequest(Request))
+		{
+			break;
+		}
 
-	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Processing queued request %d"), Request.RequestId);
+		FGenerationWorker& Worker = GenerationWorkers[WorkerIndex];
+		if (!EnsureWorkerCore(Worker))
+		{
+			//求解器无法初始化时重新排队也不会成功，按派发顺序交付一个失败结果
+			UE_LOG(LogTemp, Error, TEXT("WFCGenerator: WFC Core not initialized for request %d"), Request.RequestId);
+			FCompletedGeneration Failed;
+			Failed.Request = Request;
+			Failed.Result.ErrorMessage = TEXT("WFC core could not be initialized");
+			DeliverCompletedGeneration(NextDispatchSequence++, MoveTemp(Failed));
+			continue;
+		}
 
-	if (bUseAsyncGeneration)
-	{
-		Async(EAsyncExecution::TaskGraph, [this, Request]()
+		Worker.Core->UpdateGrid(Configuration);
+		Worker.Core->SetCancellationCheck([StopFlag = StopProcessingFlag, CancelToken = Request.CancelToken]()
 		{
-			FWFCGenerationResult Result;
-			if (!bShouldStopProcessing.load())
-			{
-				Result = WFCCore->Generate();
-			}
+			return StopFlag->load() || CancelToken->load();
+		});
+		Worker.Request = Request;
+		Worker.Sequence = NextDispatchSequence++;
+		Worker.bBusy = true;
+
+		UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Processing queued request %d on worker %d"), Request.RequestId,
+		       WorkerIndex);
+
+		FWFCCore* Core = Worker.Core.Get();
+		const int32 Sequence = Worker.Sequence;
+		TWeakObjectPtr<UWFCGeneratorComponent> WeakThis(this);
+		const bool bRecordReplay = bRecordReplays;
+		const float SaveThresholdSeconds = ReplaySaveThresholdSeconds;
+		Worker.Future = Async(EAsyncExecution::TaskGraph,
+		                      [WeakThis, Core, WorkerIndex, Sequence, Request, bRecordReplay, SaveThresholdSeconds]()
+		{
+			FCompletedGeneration Completed;
+			Completed.Request = Request;
+			Completed.Result = GenerateWithReplay(*Core, bRecordReplay, SaveThresholdSeconds);
+			Completed.CollapseHistory = Core->GetCollapseHistory();
 
-			AsyncTask(ENamedThreads::GameThread, [this, Request, Result]()
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, WorkerIndex, Sequence, Completed = MoveTemp(Completed)]() mutable
 			{
-				if (!bShouldStopProcessing.load())
+				if (UWFCGeneratorComponent* Component = WeakThis.Get())
 				{
-					OnGenerationFinished(Result, Request.Location, Request.Rotation);
+					Component->OnWorkerFinished(WorkerIndex, Sequence, MoveTemp(Completed));
 				}
-				ProcessNextRequest();
 			});
 		});
 	}
-	else
+
+	bIsProcessingQueue = HasBusyWorkers() || GetQueueSize() > 0;
+}
+
+int32 UWFCGeneratorComponent::FindIdleWorker()
+{
+	const int32 IdleIndex = GenerationWorkers.IndexOfByPredicate([](const FGenerationWorker& Worker)
 	{
-		FWFCGenerationResult Result = WFCCore->Generate();
-		OnGenerationFinished(Result, Request.Location, Request.Rotation);
-		ProcessNextRequest();
+		return !Worker.bBusy;
+	});
+	if (IdleIndex != INDEX_NONE)
+	{
+		return IdleIndex;
+	}
+
+	const int32 MaxWorkers = MaxConcurrentGenerations > 0
+		                         ? MaxConcurrentGenerations
+		                         : FMath::Max(1, FPlatformMisc::NumberOfWorkerThreadsToSpawn());
+	if (GenerationWorkers.Num() >= MaxWorkers)
+	{
+		return INDEX_NONE;
+	}
+	return GenerationWorkers.AddDefaulted();
+}
+
+bool UWFCGeneratorComponent::EnsureWorkerCore(FGenerationWorker& Worker)
+{
+	if (Worker.Core)
+	{
+		return true;
+	}
+
+	if (!TileSet)
+	{
+		return false;
+	}
+
+	TUniquePtr<FWFCCore> Core = MakeUnique<FWFCCore>();
+	if (!Core->Initialize(TileSet, Configuration))
+	{
+		return false;
+	}
+	if (PreProcessCache)
+	{
+		Core->SetPreProcessCache(PreProcessCache);
+	}
+	Core->OnStatusUpdate.BindUObject(this, &UWFCGeneratorComponent::OnWFCStatusUpdate);
+	Core->EnableStatusEvents();
+
+	Worker.Core = MoveTemp(Core);
+	return true;
+}
+
+bool UWFCGeneratorComponent::HasBusyWorkers() const
+{
+	return GenerationWorkers.ContainsByPredicate([](const FGenerationWorker& Worker) { return Worker.bBusy; });
+}
+
+void UWFCGeneratorComponent::ResetWorkerPool()
+{
+	for (FGenerationWorker& Worker : GenerationWorkers)
+	{
+		if (Worker.bBusy)
+		{
+			Worker.bStale = true;
+		}
+		else
+		{
+			Worker.Core.Reset();
+		}
+	}
+}
+
+void UWFCGeneratorComponent::CancelGenerationWorkers()
+{
+	for (FGenerationWorker& Worker : GenerationWorkers)
+	{
+		if (Worker.bBusy)
+		{
+			Worker.Future.Wait();
+			Worker.bBusy = false;
+			Worker.Sequence = INDEX_NONE;
+		}
+	}
+
+	//已派发但未交付的结果全部作废
+	CompletedGenerations.Empty();
+	NextDeliverySequence = NextDispatchSequence;
+}
+
+void UWFCGeneratorComponent::OnWorkerFinished(int32 WorkerIndex, int32 Sequence, FCompletedGeneration&& Completed)
+{
+	if (GenerationWorkers.IsValidIndex(WorkerIndex) && GenerationWorkers[WorkerIndex].Sequence == Sequence)
+	{
+		FGenerationWorker& Worker = GenerationWorkers[WorkerIndex];
+		Worker.bBusy = false;
+		Worker.Sequence = INDEX_NONE;
+		if (Worker.bStale)
+		{
+			Worker.Core.Reset();
+			Worker.bStale = false;
+		}
+	}
+
+	DeliverCompletedGeneration(Sequence, MoveTemp(Completed));
+	ProcessNextRequest();
+}
+
+void UWFCGeneratorComponent::DeliverCompletedGeneration(int32 Sequence, FCompletedGeneration&& Completed)
+{
+	if (Sequence >= NextDeliverySequence)
+	{
+		CompletedGenerations.Add(Sequence, MoveTemp(Completed));
+	}
+
+	FCompletedGeneration Next;
+	while (CompletedGenerations.RemoveAndCopyValue(NextDeliverySequence, Next))
+	{
+		NextDeliverySequence++;
+		if (Next.Request.IsCancelled())
+		{
+			UE_LOG(LogTemp, Verbose, TEXT("WFCGenerator: Dropping result of cancelled request %d"), Next.Request.RequestId);
+		}
+		else if (!StopProcessingFlag->load())
+		{
+			OnGenerationFinished(Next.Result, Next.Request.Location, Next.Request.Rotation, Next.CollapseHistory);
+		}
 	}
 }
 
 void UWFCGeneratorComponent::StopGeneration()
 {
-	bShouldStopProcessing.store(true);
+	StopProcessingFlag->store(true);
 	bIsProcessingQueue = false;
 	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Generation stopped"));
 
@@ -265,6 +546,7 @@ void UWFCGeneratorComponent::StopGeneration()
 	{
 		GenerationFuture.Wait();
 	}
+	CancelGenerationWorkers();
 }
 
 void UWFCGeneratorComponent::ClearGeneration()
@@ -293,7 +575,7 @@ void UWFCGeneratorComponent::ClearQueue()
 		UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Cleared %d requests from queue"), ClearedCount);
 	}
 	
-	bShouldStopProcessing.store(false);
+	StopProcessingFlag->store(false);
 }
 
 int32 UWFCGeneratorComponent::GetQueueSize() const
@@ -317,6 +599,7 @@ void UWFCGeneratorComponent::SetTileSet(UWFCTileSet* NewTileSet)
 	}
 
 	TileSet = NewTileSet;
+	ResetWorkerPool();
 	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: TileSet updated"));
 }
 
@@ -365,9 +648,12 @@ void UWFCGeneratorComponent::NextCollapseStep()
 	}
 	if (CurCollapseHistoryStep < 0) return;
 
+	//实例化显示时没有逐格子的Actor，不支持逐步显示
 	FWFCCoordinate Coord = LastCollapseHistory[CurCollapseHistoryStep];
-	SpawnedActors[Coord]->GetComponentByClass<UStaticMeshComponent>()->SetVisibility(true);
-	UKismetSystemLibrary::DrawDebugSphere(GetWorld(), SpawnedActors[Coord]->GetActorLocation(), 50, 12, FColor::Green,
+	AActor* SpawnedActor = SpawnedActors.FindRef(Coord);
+	if (!SpawnedActor) return;
+	SpawnedActor->GetComponentByClass<UStaticMeshComponent>()->SetVisibility(true);
+	UKismetSystemLibrary::DrawDebugSphere(GetWorld(), SpawnedActor->GetActorLocation(), 50, 12, FColor::Green,
 	                                      3, 1);
 }
 
@@ -377,9 +663,13 @@ void UWFCGeneratorComponent::PrevCollapseStep()
 	if (CurCollapseHistoryStep > 0 && CurCollapseHistoryStep <= LastCollapseHistory.Num() - 1)
 	{
 		FWFCCoordinate Coord = LastCollapseHistory[CurCollapseHistoryStep];
-		SpawnedActors[Coord]->GetComponentByClass<UStaticMeshComponent>()->SetVisibility(false);
-		UKismetSystemLibrary::DrawDebugSphere(GetWorld(), SpawnedActors[Coord]->GetActorLocation(), 50, 12, FColor::Red,
-		                                      3, 1);
+		AActor* SpawnedActor = SpawnedActors.FindRef(Coord);
+		if (SpawnedActor)
+		{
+			SpawnedActor->GetComponentByClass<UStaticMeshComponent>()->SetVisibility(false);
+			UKismetSystemLibrary::DrawDebugSphere(GetWorld(), SpawnedActor->GetActorLocation(), 50, 12, FColor::Red,
+			                                      3, 1);
+		}
 	}
 
 	CurCollapseHistoryStep--;
@@ -399,7 +689,7 @@ void UWFCGeneratorComponent::ExecuteGeneration()
 
 	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Executing synchronous generation"));
 
-	FWFCGenerationResult Result = WFCCore->Generate();
+	FWFCGenerationResult Result = GenerateWithReplay(*WFCCore, bRecordReplays, ReplaySaveThresholdSeconds);
 	OnGenerationFinished(Result);
 }
 
@@ -407,18 +697,20 @@ void UWFCGeneratorComponent::ExecuteGenerationAsync()
 {
 	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Executing asynchronous generation"));
 
-	GenerationFuture = Async(EAsyncExecution::ThreadPool, [this]() -> FWFCGenerationResult
+	GenerationFuture = Async(EAsyncExecution::ThreadPool,
+	                         [this, bRecordReplay = bRecordReplays, SaveThresholdSeconds = ReplaySaveThresholdSeconds]()
+	                         -> FWFCGenerationResult
 	{
-		if (WFCCore && !bShouldStopProcessing.load())
+		if (WFCCore && !StopProcessingFlag->load())
 		{
-			return WFCCore->Generate();
+			return GenerateWithReplay(*WFCCore, bRecordReplay, SaveThresholdSeconds);
 		}
 		return FWFCGenerationResult();
 	});
 
 	AsyncTask(ENamedThreads::GameThread, [this]()
 	{
-		if (GenerationFuture.IsValid() && !bShouldStopProcessing.load())
+		if (GenerationFuture.IsValid() && !StopProcessingFlag->load())
 		{
 			FWFCGenerationResult Result = GenerationFuture.Get();
 			OnGenerationFinished(Result);
@@ -436,8 +728,8 @@ void UWFCGeneratorComponent::ExecuteGenerationAt(FVector Location, FRotator Rota
 
 	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Executing synchronous generation"));
 
-	FWFCGenerationResult Result = WFCCore->Generate();
-	OnGenerationFinished(Result, Location, Rotation);
+	FWFCGenerationResult Result = GenerateWithReplay(*WFCCore, bRecordReplays, ReplaySaveThresholdSeconds);
+	OnGenerationFinished(Result, Location, Rotation, WFCCore->GetCollapseHistory());
 }
 
 void UWFCGeneratorComponent::OnGenerationFinished(const FWFCGenerationResult& Result)
@@ -463,10 +755,10 @@ void UWFCGeneratorComponent::OnGenerationFinished(const FWFCGenerationResult& Re
 }
 
 void UWFCGeneratorComponent::OnGenerationFinished(const FWFCGenerationResult& Result, FVector Location,
-                                                  FRotator Rotation)
+                                                  FRotator Rotation, const TArray<FWFCCoordinate>& CollapseHistory)
 {
 	LastResult = Result;
-	LastCollapseHistory = WFCCore->GetCollapseHistory();
+	LastCollapseHistory = CollapseHistory;
 	CurCollapseHistoryStep = LastCollapseHistory.Num() - 1;
 
 	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Generation finished - Success: %s, Iterations: %d, Time: %.3fs"),
@@ -500,10 +792,16 @@ void UWFCGeneratorComponent::CreateVisualization(const FWFCGenerationResult& Res
 	}
 
 	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Creating visualization for %d tiles"),
-	       Result.TileAssignments.Num());
+	       Result.GetPlacedTileCount());
+
+	if (bUseInstancedVisualization)
+	{
+		CreateInstancedVisualization(Result, RootVisualization, true);
+		return;
+	}
 
 	int32 CreatedCount = 0;
-	for (const auto& [Coord, TileIndex] : Result.TileAssignments)
+	Result.ForEachPlacedTile([&](const FWFCCoordinate& Coord, int32 TileIndex)
 	{
 		if (AActor* TileActor = SpawnTileActor(Coord, TileIndex))
 		{
@@ -511,7 +809,7 @@ void UWFCGeneratorComponent::CreateVisualization(const FWFCGenerationResult& Res
 			OnTileGenerated.Broadcast(Coord, TileIndex);
 			CreatedCount++;
 		}
-	}
+	});
 
 	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Created %d tile actors"), CreatedCount);
 }
@@ -532,10 +830,18 @@ USceneComponent* UWFCGeneratorComponent::CreateVisualizationAt(const FWFCGenerat
 	}
 
 	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Creating visualization for %d tiles"),
-	       Result.TileAssignments.Num());
+	       Result.GetPlacedTileCount());
+
+	if (bUseInstancedVisualization)
+	{
+		CreateInstancedVisualization(Result, ParentComp, false);
+		ParentComp->SetWorldLocation(Location);
+		ParentComp->SetWorldRotation(Rotation);
+		return ParentComp;
+	}
 
 	int32 CreatedCount = 0;
-	for (const auto& [Coord, TileIndex] : Result.TileAssignments)
+	Result.ForEachPlacedTile([&](const FWFCCoordinate& Coord, int32 TileIndex)
 	{
 		if (AActor* TileActor = SpawnTileActor(Coord, TileIndex))
 		{
@@ -544,7 +850,7 @@ USceneComponent* UWFCGeneratorComponent::CreateVisualizationAt(const FWFCGenerat
 			OnTileGenerated.Broadcast(Coord, TileIndex);
 			CreatedCount++;
 		}
-	}
+	});
 	ParentComp->SetWorldLocation(Location);
 	ParentComp->SetWorldRotation(Rotation);
 	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Created %d tile actors"), CreatedCount);
@@ -558,29 +864,18 @@ USceneComponent* UWFCGeneratorComponent::CreateVisualizationAtByFrame(const FWFC
 	VisualizationData.ParentLocation = Location;
 	VisualizationData.ParentRotation = Rotation;
 	VisualizationData.bShowEmptyTiles = Configuration.bShowEmptyTiles;
+	VisualizationData.bUseInstancedMeshes = bUseInstancedVisualization;
+	VisualizationData.bEnableInstanceCollision = bInstancedCollision;
 	
 	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Creating visualization for %d tiles"),
-		   Result.TileAssignments.Num());
+		   Result.GetPlacedTileCount());
 
 	int32 CreatedCount = 0;
-	for (const auto& [Coord, TileIndex] : Result.TileAssignments)
-	{
-		FWFCVisualizationTile Tile;
-		FWFCTileDefinition TileDef = TileSet->GetTile(TileIndex);
-		FVector WorldPosition = CoordinateToWorldPosition(Coord);
-		FRotator WorldRotation = TileDef.BaseRotation;
-		Tile.TileName = TileDef.TileName;
-		Tile.Location =  WorldPosition;
-		Tile.Rotation = WorldRotation;
-		Tile.StaticMesh = TileDef.Mesh;
-		Tile.Material = TileDef.Material;
-		Tile.Category = TileDef.Category;
-		VisualizationData.Tiles.Add(Tile);
-	}
+	BuildVisualizationTiles(Result, VisualizationData.Tiles);
 
 	AWFCVisualizer* Visualizer = GetWorld()->SpawnActor<AWFCVisualizer>();
 	Visualizer->SetActorLocation(FVector::ZeroVector);
-	Visualizer->StartVisualization(GenerationActorPerFrame, VisualizationData);
+	Visualizer->StartVisualization(GenerationActorPerFrame, VisualizationData, SpawnBudgetMicroseconds);
 	UE_LOG(LogTemp, Log, TEXT("WFCGenerator: Created %d tile actors"), CreatedCount);
 	return nullptr;
 }
@@ -598,6 +893,52 @@ void UWFCGeneratorComponent::ClearVisualization()
 	}
 
 	SpawnedActors.Empty();
+
+	for (UHierarchicalInstancedStaticMeshComponent* Instanced : InstancedComponents)
+	{
+		if (IsValid(Instanced))
+		{
+			Instanced->DestroyComponent();
+		}
+	}
+	InstancedComponents.Empty();
+}
+
+void UWFCGeneratorComponent::BuildVisualizationTiles(const FWFCGenerationResult& Result,
+                                                     TArray<FWFCVisualizationTile>& OutTiles) const
+{
+	OutTiles.Reserve(OutTiles.Num() + Result.GetPlacedTileCount());
+	Result.ForEachPlacedTile([&](const FWFCCoordinate& Coord, int32 TileIndex)
+	{
+		FWFCVisualizationTile Tile;
+		FWFCTileDefinition TileDef = TileSet->GetTile(TileIndex);
+		Tile.TileName = TileDef.TileName;
+		Tile.Location = CoordinateToWorldPosition(Coord);
+		Tile.Rotation = TileDef.BaseRotation;
+		Tile.StaticMesh = TileDef.Mesh;
+		Tile.Material = TileDef.Material;
+		Tile.Category = TileDef.Category;
+		OutTiles.Add(Tile);
+	});
+}
+
+void UWFCGeneratorComponent::CreateInstancedVisualization(const FWFCGenerationResult& Result, USceneComponent* Parent,
+                                                          bool bWorldSpace)
+{
+	TArray<FWFCVisualizationTile> Tiles;
+	BuildVisualizationTiles(Result, Tiles);
+
+	//与逐Actor路径一致，空瓦片同样生成
+	for (UHierarchicalInstancedStaticMeshComponent* Instanced : AWFCVisualizer::CreateInstancedComponents(
+		     GetOwner(), Parent, Tiles, true, bInstancedCollision, bWorldSpace))
+	{
+		InstancedComponents.Add(Instanced);
+	}
+
+	Result.ForEachPlacedTile([this](const FWFCCoordinate& Coord, int32 TileIndex)
+	{
+		OnTileGenerated.Broadcast(Coord, TileIndex);
+	});
 }
 
 AActor* UWFCGeneratorComponent::SpawnTileActor(const FWFCCoordinate& Position, int32 TileIndex)
@@ -691,4 +1032,5 @@ void UWFCGeneratorComponent::SetPreProcessCache(UWFCPreProcessCache* InCache)
 	{
 		WFCCore->SetPreProcessCache(PreProcessCache);
 	}
+	ResetWorkerPool();
 }
\ No newline at end of file
@@ -8,9 +8,20 @@
 #include "WFCPreProcessCache.h"
 #include "WFCGeneratorComponent.generated.h"
 
+class UHierarchicalInstancedStaticMeshComponent;
+
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnWFCGenerationComplete, const FWFCGenerationResult&, Result);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnWFCTileGenerated, const FWFCCoordinate&, Position, int32, TileIndex);
 
+//队列优先级，数值越大越先处理
+UENUM(BlueprintType)
+enum class EWFCRequestPriority : uint8
+{
+    Background = 0  UMETA(DisplayName = "Background"),
+    Normal = 1      UMETA(DisplayName = "Normal"),
+    Preview = 2     UMETA(DisplayName = "Preview")
+};
+
 USTRUCT(BlueprintType)
 struct FGenerationRequest
 {
@@ -25,9 +36,19 @@ struct FGenerationRequest
     UPROPERTY(BlueprintReadOnly)
     int RequestId = 0;
 
+    UPROPERTY(BlueprintReadOnly)
+    EWFCRequestPriority Priority = EWFCRequestPriority::Normal;
+
+    //求解器在迭代之间检查，置位后该请求尽快结束且不交付结果
+    TSharedPtr<std::atomic<bool>> CancelToken;
+
     FGenerationRequest() = default;
-    FGenerationRequest(FVector InLocation, FRotator InRotation, uint32 InRequestId)
-        : Location(InLocation), Rotation(InRotation), RequestId(InRequestId) {}
+    FGenerationRequest(FVector InLocation, FRotator InRotation, uint32 InRequestId,
+                       EWFCRequestPriority InPriority = EWFCRequestPriority::Normal)
+        : Location(InLocation), Rotation(InRotation), RequestId(InRequestId), Priority(InPriority),
+          CancelToken(MakeShared<std::atomic<bool>>(false)) {}
+
+    bool IsCancelled() const { return CancelToken.IsValid() && CancelToken->load(); }
 };
 
 UCLASS(ClassGroup=(WFC), meta=(BlueprintSpawnableComponent))
@@ -62,15 +83,37 @@ public:
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Configuration")
     float CellSize = 100.0f;
 
+    //按(网格, 材质)合并为HISM实例显示，代替每格一个Actor
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Configuration")
+    bool bUseInstancedVisualization = false;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Configuration", meta = (EditCondition = "bUseInstancedVisualization"))
+    bool bInstancedCollision = false;
+
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Configuration")
     bool bUseAsyncGeneration = false;
 
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Configuration")
     int GenerationActorPerFrame = 5;
 
+    //分帧生成时每帧可用的时间(微秒)，0表示按GenerationActorPerFrame固定数量
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Configuration", meta = (ClampMin = "0"))
+    float SpawnBudgetMicroseconds = 0.0f;
+
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Configuration")
     int MaxQueueSize = 10;
 
+    //异步队列同时运行的求解器数量，0表示使用工作线程数
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Configuration")
+    int MaxConcurrentGenerations = 0;
+
+    //记录生成的随机选择序列，失败或耗时不低于ReplaySaveThresholdSeconds时写入Saved/WFCReplays，用wfc.Replay重放
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Configuration")
+    bool bRecordReplays = false;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Configuration", meta = (EditCondition = "bRecordReplays", ClampMin = "0"))
+    float ReplaySaveThresholdSeconds = 1.0f;
+
     UPROPERTY(BlueprintAssignable, Category = "WFC Events")
     FOnWFCGenerationComplete OnGenerationComplete;
 
@@ -105,6 +148,14 @@ public:
     UFUNCTION(BlueprintCallable, Category = "WFC")
     int QueueGeneration(FVector Location, FRotator Rotation);
 
+    //同一位置已有等待中的请求时合并为一个，正在运行的旧请求被取消
+    UFUNCTION(BlueprintCallable, Category = "WFC")
+    int QueueGenerationWithPriority(FVector Location, FRotator Rotation, EWFCRequestPriority Priority);
+
+    //取消等待中或正在运行的请求，找不到时返回false
+    UFUNCTION(BlueprintCallable, Category = "WFC")
+    bool CancelRequest(int RequestId);
+
     UFUNCTION(BlueprintCallable, BlueprintPure, Category = "WFC")
     bool IsGenerating() const { return bIsProcessingQueue; }
 
@@ -152,7 +203,8 @@ protected:
     TArray<FGenerationRequest> PendingRequests;
     mutable FCriticalSection QueueLock;
     std::atomic<uint32> NextRequestId{1};
-    std::atomic<bool> bShouldStopProcessing{false};
+    //工作线程上的取消检查持有这份标志，组件销毁后仍然有效
+    TSharedRef<std::atomic<bool>> StopProcessingFlag = MakeShared<std::atomic<bool>>(false);
 
     TUniquePtr<FWFCCore> WFCCore;
     
@@ -165,6 +217,9 @@ protected:
     UPROPERTY()
     TObjectPtr<USceneComponent> RootVisualization;
 
+    UPROPERTY()
+    TArray<TObjectPtr<UHierarchicalInstancedStaticMeshComponent>> InstancedComponents;
+
     TFuture<FWFCGenerationResult> GenerationFuture;
 
     UPROPERTY()
@@ -175,18 +230,55 @@ protected:
 
     int CurCollapseHistoryStep;
 
+    //异步队列的求解器池，每个工作者持有独立的FWFCCore，编译数据按内容共享
+    struct FGenerationWorker
+    {
+        TUniquePtr<FWFCCore> Core;
+        TFuture<void> Future;
+        FGenerationRequest Request;
+        int32 Sequence = INDEX_NONE;
+        bool bBusy = false;
+        //运行期间配置发生变化，完成后重建
+        bool bStale = false;
+    };
+
+    struct FCompletedGeneration
+    {
+        FGenerationRequest Request;
+        FWFCGenerationResult Result;
+        TArray<FWFCCoordinate> CollapseHistory;
+    };
+
+    TArray<FGenerationWorker> GenerationWorkers;
+    //按派发顺序编号，结果按编号依次交付
+    TMap<int32, FCompletedGeneration> CompletedGenerations;
+    int32 NextDispatchSequence = 0;
+    int32 NextDeliverySequence = 0;
+
 private:
     void ExecuteGeneration();
     void ExecuteGenerationAsync();
     void ExecuteGenerationAt(FVector Location, FRotator Rotation);
+    int EnqueueRequest(FVector Location, FRotator Rotation, EWFCRequestPriority Priority, bool bRespectQueueLimit);
+    bool PopNextRequest(FGenerationRequest& OutRequest);
     void ProcessNextRequest();
+    int32 FindIdleWorker();
+    bool EnsureWorkerCore(FGenerationWorker& Worker);
+    bool HasBusyWorkers() const;
+    void ResetWorkerPool();
+    void CancelGenerationWorkers();
+    void OnWorkerFinished(int32 WorkerIndex, int32 Sequence, FCompletedGeneration&& Completed);
+    void DeliverCompletedGeneration(int32 Sequence, FCompletedGeneration&& Completed);
     void OnGenerationFinished(const FWFCGenerationResult& Result);
-    void OnGenerationFinished(const FWFCGenerationResult& Result, FVector Location, FRotator Rotation);
+    void OnGenerationFinished(const FWFCGenerationResult& Result, FVector Location, FRotator Rotation,
+                              const TArray<FWFCCoordinate>& CollapseHistory);
 
     void CreateVisualization(const FWFCGenerationResult& Result);
     USceneComponent* CreateVisualizationAt(const FWFCGenerationResult& Result,  FVector Location, FRotator Rotation);
     USceneComponent* CreateVisualizationAtByFrame(const FWFCGenerationResult& Result,  FVector Location, FRotator Rotation);
     void ClearVisualization();
+    void BuildVisualizationTiles(const FWFCGenerationResult& Result, TArray<FWFCVisualizationTile>& OutTiles) const;
+    void CreateInstancedVisualization(const FWFCGenerationResult& Result, USceneComponent* Parent, bool bWorldSpace);
     AActor* SpawnTileActor(const FWFCCoordinate& Position, int32 TileIndex);
     FVector CoordinateToWorldPosition(const FWFCCoordinate& Coord) const;
     FVector CoordinateToLocalPosition(const FWFCCoordinate& Coord) const;
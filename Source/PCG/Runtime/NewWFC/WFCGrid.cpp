@@ -0,0 +1,102 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "WFCGrid.h"
+
+//与EWFCDirection顺序一致
+const FIntVector FWFCGrid::DirectionOffsets[FWFCGrid::NumDirections] = {
+	FIntVector(0, 0, 1),
+	FIntVector(0, 0, -1),
+	FIntVector(0, 1, 0),
+	FIntVector(0, -1, 0),
+	FIntVector(1, 0, 0),
+	FIntVector(-1, 0, 0)
+};
+
+void FWFCGrid::Init(const FIntVector& InSize, bool bInPeriodic, int32 TileCount)
+{
+	const int32 TotalCells = InSize.X * InSize.Y * InSize.Z;
+
+	if (Size != InSize || bPeriodic != bInPeriodic)
+	{
+		Size = InSize;
+		bPeriodic = bInPeriodic;
+		BuildNeighborIndices();
+	}
+
+	Cells.Reset(TotalCells);
+	Cells.AddDefaulted(TotalCells);
+
+	NumTiles = TileCount;
+	WordsPerCell = FWFCTileMask::GetNumWords(TileCount);
+	TileWords.Init(~0ull, TotalCells * WordsPerCell);
+	//超出瓦片数的高位保持为0
+	const int32 UsedBits = TileCount % FWFCTileMask::BitsPerWord;
+	if (UsedBits != 0)
+	{
+		for (int32 Index = 0; Index < TotalCells; Index++)
+		{
+			GetTileWords(Index)[WordsPerCell - 1] = (1ull << UsedBits) - 1;
+		}
+	}
+}
+
+void FWFCGrid::CopyStateFrom(const FWFCGrid& Source)
+{
+	if (Size != Source.Size || bPeriodic != Source.bPeriodic || NumTiles != Source.NumTiles)
+	{
+		*this = Source;
+		return;
+	}
+
+	FMemory::Memcpy(Cells.GetData(), Source.Cells.GetData(), Cells.Num() * sizeof(FWFCCell));
+	FMemory::Memcpy(TileWords.GetData(), Source.TileWords.GetData(), TileWords.Num() * sizeof(uint64));
+}
+
+void FWFCGrid::Empty()
+{
+	Cells.Empty();
+	TileWords.Empty();
+	NumTiles = 0;
+	WordsPerCell = 0;
+	NeighborIndices.Empty();
+	Size = FIntVector::ZeroValue;
+	bPeriodic = false;
+}
+
+SIZE_T FWFCGrid::GetAllocatedSize() const
+{
+	return Cells.GetAllocatedSize() + TileWords.GetAllocatedSize() + NeighborIndices.GetAllocatedSize();
+}
+
+void FWFCGrid::BuildNeighborIndices()
+{
+	const int32 TotalCells = Size.X * Size.Y * Size.Z;
+	NeighborIndices.SetNumUninitialized(TotalCells * NumDirections);
+
+	for (int32 X = 0; X < Size.X; X++)
+	{
+		for (int32 Y = 0; Y < Size.Y; Y++)
+		{
+			for (int32 Z = 0; Z < Size.Z; Z++)
+			{
+				const int32 Index = GetIndex(X, Y, Z);
+				for (int32 Dir = 0; Dir < NumDirections; Dir++)
+				{
+					int32 NX = X + DirectionOffsets[Dir].X;
+					int32 NY = Y + DirectionOffsets[Dir].Y;
+					int32 NZ = Z + DirectionOffsets[Dir].Z;
+
+					// 处理周期性边界
+					if (bPeriodic)
+					{
+						NX = (NX + Size.X) % Size.X;
+						NY = (NY + Size.Y) % Size.Y;
+						NZ = (NZ + Size.Z) % Size.Z;
+					}
+
+					NeighborIndices[Index * NumDirections + Dir] = GetIndex(NX, NY, NZ);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,147 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "WFCTypes.h"
+#include "WFCTileMask.h"
+
+//可能瓦片的位集中存放在FWFCGrid的连续字块里，格子本身只有定长字段，整个网格可以按块拷贝
+struct FWFCCell
+{
+    bool bCollapsed = false;
+    int32 CollapsedTileIndex = -1;
+    float Entropy = 0.0f;
+    //可能瓦片的权重和与Weight*Log(Weight)和，移除瓦片时增量更新
+    double SumWeights = 0.0;
+    double SumWeightLogWeights = 0.0;
+
+    bool IsCollapsed() const { return bCollapsed; }
+};
+
+//按X*Y*Z线性存储的网格，Index = (X * SizeY + Y) * SizeZ + Z
+class PCG_API FWFCGrid
+{
+public:
+    static constexpr int32 NumDirections = 6;
+    static const FIntVector DirectionOffsets[NumDirections];
+
+    template <typename CellType>
+    struct TEntry
+    {
+        FWFCCoordinate Coord;
+        CellType& Cell;
+    };
+
+    template <typename GridType, typename CellType>
+    class TIterator
+    {
+    public:
+        TIterator(GridType& InGrid, int32 InIndex) : Grid(InGrid), Index(InIndex) {}
+
+        TEntry<CellType> operator*() const { return {Grid.GetCoordinate(Index), Grid[Index]}; }
+        TIterator& operator++() { ++Index; return *this; }
+        bool operator!=(const TIterator& Other) const { return Index != Other.Index; }
+
+    private:
+        GridType& Grid;
+        int32 Index;
+    };
+
+    using FIterator = TIterator<FWFCGrid, FWFCCell>;
+    using FConstIterator = TIterator<const FWFCGrid, const FWFCCell>;
+
+    void Init(const FIntVector& InSize, bool bInPeriodic, int32 TileCount);
+    void Empty();
+    SIZE_T GetAllocatedSize() const;
+    //尺寸相同时按块拷贝格子和位集，不重新分配
+    void CopyStateFrom(const FWFCGrid& Source);
+
+    int32 Num() const { return Cells.Num(); }
+    int32 GetTileCount() const { return NumTiles; }
+    int32 GetWordsPerCell() const { return WordsPerCell; }
+    const FIntVector& GetSize() const { return Size; }
+    bool IsPeriodic() const { return bPeriodic; }
+
+    bool IsValidIndex(int32 Index) const { return Cells.IsValidIndex(Index); }
+    bool IsValidCoordinate(int32 X, int32 Y, int32 Z) const
+    {
+        return X >= 0 && X < Size.X && Y >= 0 && Y < Size.Y && Z >= 0 && Z < Size.Z;
+    }
+
+    int32 GetIndex(int32 X, int32 Y, int32 Z) const
+    {
+        return IsValidCoordinate(X, Y, Z) ? (X * Size.Y + Y) * Size.Z + Z : INDEX_NONE;
+    }
+    int32 GetIndex(const FWFCCoordinate& Coord) const { return GetIndex(Coord.X, Coord.Y, Coord.Z); }
+
+    FWFCCoordinate GetCoordinate(int32 Index) const
+    {
+        return FWFCCoordinate(Index / (Size.Y * Size.Z), (Index / Size.Z) % Size.Y, Index % Size.Z);
+    }
+
+    //边界外（非周期）返回INDEX_NONE
+    int32 GetNeighborIndex(int32 Index, int32 Direction) const
+    {
+        return NeighborIndices[Index * NumDirections + Direction];
+    }
+
+    uint64* GetTileWords(int32 Index) { return TileWords.GetData() + Index * WordsPerCell; }
+    const uint64* GetTileWords(int32 Index) const { return TileWords.GetData() + Index * WordsPerCell; }
+
+    bool CanPlace(int32 Index, int32 TileIndex) const
+    {
+        return TileIndex >= 0 && TileIndex < NumTiles &&
+            ((GetTileWords(Index)[TileIndex / FWFCTileMask::BitsPerWord] >> (TileIndex % FWFCTileMask::BitsPerWord)) & 1ull);
+    }
+    void SetPossibleTile(int32 Index, int32 TileIndex, bool bValue)
+    {
+        const uint64 Bit = 1ull << (TileIndex % FWFCTileMask::BitsPerWord);
+        uint64& Word = GetTileWords(Index)[TileIndex / FWFCTileMask::BitsPerWord];
+        Word = bValue ? Word | Bit : Word & ~Bit;
+    }
+    //只保留一个瓦片
+    void SetSinglePossibleTile(int32 Index, int32 TileIndex)
+    {
+        FMemory::Memzero(GetTileWords(Index), WordsPerCell * sizeof(uint64));
+        SetPossibleTile(Index, TileIndex, true);
+    }
+    int32 GetPossibleTileCount(int32 Index) const { return FWFCTileMask::CountSetBits(GetTileWords(Index), WordsPerCell); }
+    int32 FindFirstPossibleTile(int32 Index) const { return FWFCTileMask::FindFirstSetBit(GetTileWords(Index), WordsPerCell); }
+    template <typename FuncType>
+    void ForEachPossibleTile(int32 Index, FuncType&& Func) const
+    {
+        FWFCTileMask::ForEachSetBit(GetTileWords(Index), WordsPerCell, Forward<FuncType>(Func));
+    }
+
+    FWFCCell& operator[](int32 Index) { return Cells[Index]; }
+    const FWFCCell& operator[](int32 Index) const { return Cells[Index]; }
+
+    FWFCCell* Find(const FWFCCoordinate& Coord)
+    {
+        const int32 Index = GetIndex(Coord);
+        return Index != INDEX_NONE ? &Cells[Index] : nullptr;
+    }
+    const FWFCCell* Find(const FWFCCoordinate& Coord) const
+    {
+        const int32 Index = GetIndex(Coord);
+        return Index != INDEX_NONE ? &Cells[Index] : nullptr;
+    }
+
+    FIterator begin() { return FIterator(*this, 0); }
+    FIterator end() { return FIterator(*this, Cells.Num()); }
+    FConstIterator begin() const { return FConstIterator(*this, 0); }
+    FConstIterator end() const { return FConstIterator(*this, Cells.Num()); }
+
+private:
+    void BuildNeighborIndices();
+
+    FIntVector Size = FIntVector::ZeroValue;
+    bool bPeriodic = false;
+    TArray<FWFCCell> Cells;
+    //[Cell * WordsPerCell + Word]
+    TArray<uint64> TileWords;
+    int32 NumTiles = 0;
+    int32 WordsPerCell = 0;
+    TArray<int32> NeighborIndices;
+};
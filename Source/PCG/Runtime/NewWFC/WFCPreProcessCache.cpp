@@ -18,6 +18,28 @@ void UWFCPreProcessCache::CreateCacheDataTable()
 #endif
 }
 
+namespace
+{
+    int32 GetLinearIndex(const FWFCCoordinate& Coord, const FIntVector& GridSize)
+    {
+        return (Coord.X * GridSize.Y + Coord.Y) * GridSize.Z + Coord.Z;
+    }
+
+    FWFCCoordinate GetCoordinate(int32 Index, const FIntVector& GridSize)
+    {
+        return FWFCCoordinate(Index / (GridSize.Y * GridSize.Z), (Index / GridSize.Z) % GridSize.Y, Index % GridSize.Z);
+    }
+
+    void InitPackedGrid(FWFCPackedGridCache& PackedGrid, const FIntVector& GridSize, int32 TileCount)
+    {
+        PackedGrid.GridSize = GridSize;
+        PackedGrid.TileCount = TileCount;
+        PackedGrid.WordsPerCell = FWFCTileMask::GetNumWords(TileCount);
+        PackedGrid.CollapsedBits.SetNumZeroed(FMath::DivideAndRoundUp(PackedGrid.GetNumCells(), 64));
+        PackedGrid.PossibleWords.SetNumZeroed(PackedGrid.GetNumCells() * PackedGrid.WordsPerCell);
+    }
+}
+
 void UWFCPreProcessCache::GenerateAllCaches()
 {
     if (!TileSet)
@@ -26,13 +48,12 @@ void UWFCPreProcessCache::GenerateAllCaches()
         return;
     }
 
-    if (!CacheDataTable)
+    PackedEntries.Empty();
+    PackedCacheData.Empty();
     {
-        UE_LOG(LogTemp, Error, TEXT("WFCPreProcessCache: CacheDataTable is null"));
-        return;
+        FScopeLock Lock(&DecodedGridsLock);
+        DecodedGrids.Empty();
     }
-
-    CacheMap.Empty();
     
     UE_LOG(LogTemp, Log, TEXT("WFCPreProcessCache: Starting cache generation from %dx%dx%d to %dx%dx%d"), 
            MinGridSize, MinGridSize, MinGridSize, MaxGridSize, MaxGridSize, MaxGridSize);
@@ -46,8 +67,7 @@ void UWFCPreProcessCache::GenerateAllCaches()
         {
             int Z = GridHeight;
             FIntVector GridSize(X, Y, Z);
-            FWFCPreProcessCacheData CacheData = GenerateCacheForGridSize(GridSize);
-            CacheMap.Add(GridSize, CacheData);
+            AddPackedGrid(GenerateCacheForGridSize(GridSize));
             TotalCaches++;
                 
             if (TotalCaches % 100 == 0)
@@ -58,17 +78,19 @@ void UWFCPreProcessCache::GenerateAllCaches()
         }
     }
 
-    double EndTime = FPlatformTime::Seconds();
-    UE_LOG(LogTemp, Log, TEXT("WFCPreProcessCache: Generated %d caches in %.2f seconds"), 
-           TotalCaches, EndTime - StartTime);
+    bCacheLoaded = true;
+#if WITH_EDITOR
+    MarkPackageDirty();
+#endif
 
-    SaveCacheToDataTable();
+    double EndTime = FPlatformTime::Seconds();
+    UE_LOG(LogTemp, Log, TEXT("WFCPreProcessCache: Generated %d caches (%d bytes) in %.2f seconds"), 
+           TotalCaches, PackedCacheData.Num(), EndTime - StartTime);
 }
 
-FWFCPreProcessCacheData UWFCPreProcessCache::GenerateCacheForGridSize(const FIntVector& GridSize)
+FWFCPackedGridCache UWFCPreProcessCache::GenerateCacheForGridSize(const FIntVector& GridSize)
 {
-    FWFCPreProcessCacheData CacheData;
-    CacheData.GridSize = GridSize;
+    FWFCPackedGridCache PackedGrid;
 
     FWFCCore TempCore;
     FWFCConfiguration Config;
@@ -82,46 +104,198 @@ FWFCPreProcessCacheData UWFCPreProcessCache::GenerateCacheForGridSize(const FInt
     {
         UE_LOG(LogTemp, Error, TEXT("WFCPreProcessCache: Failed to initialize core for size %s"), 
                *GridSize.ToString());
-        return CacheData;
+        return PackedGrid;
     }
 
-    const TMap<FWFCCoordinate, FWFCCell>& InitialGrid = TempCore.GetGrid();
-    
-    TArray<FWFCCoordinate> BoundaryCoords;
-    for (const auto& [Coord, Cell] : InitialGrid)
+    TempCore.CellPreProcess();
+
+    const FWFCGrid& ProcessedGrid = TempCore.GetGrid();
+    InitPackedGrid(PackedGrid, GridSize, TileSet->GetTileCount());
+    FMemory::Memcpy(PackedGrid.PossibleWords.GetData(), ProcessedGrid.GetTileWords(0),
+                    PackedGrid.PossibleWords.Num() * sizeof(uint64));
+    for (int32 CellIndex = 0; CellIndex < ProcessedGrid.Num(); CellIndex++)
     {
-        if (IsBoundaryCoordinate(Coord, GridSize))
+        if (ProcessedGrid[CellIndex].IsCollapsed())
         {
-            BoundaryCoords.Add(Coord);
+            PackedGrid.CollapsedBits[CellIndex / 64] |= 1ull << (CellIndex % 64);
         }
     }
+    for (const FWFCCoordinate& Coord : TempCore.GetCollapseHistory())
+    {
+        PackedGrid.CollapseHistory.Add(ProcessedGrid.GetIndex(Coord));
+    }
+    return PackedGrid;
+}
+
+FName UWFCPreProcessCache::GetRowNameForGridSize(const FIntVector& GridSize)
+{
+    return FName(*FString::Printf(TEXT("Grid_%d_%d_%d"), GridSize.X, GridSize.Y, GridSize.Z));
+}
+
+//打包格式：坍缩位图、每格PossibleTiles的64位字、坍缩顺序数量与下标
+void UWFCPreProcessCache::AddPackedGrid(const FWFCPackedGridCache& PackedGrid)
+{
+    if (PackedGrid.GetNumCells() == 0)
+    {
+        return;
+    }
+
+    const int32 HistoryCount = PackedGrid.CollapseHistory.Num();
+    const int64 NumBytes = (PackedGrid.CollapsedBits.Num() + PackedGrid.PossibleWords.Num()) * sizeof(uint64) +
+        sizeof(int32) + HistoryCount * sizeof(int32);
+
+    FWFCPackedCacheEntry& Entry = PackedEntries.AddDefaulted_GetRef();
+    Entry.GridSize = PackedGrid.GridSize;
+    Entry.TileCount = PackedGrid.TileCount;
+    Entry.Offset = PackedCacheData.Num();
+    Entry.NumBytes = NumBytes;
 
-    for (const FWFCCoordinate& Coord : BoundaryCoords)
+    PackedCacheData.AddUninitialized(NumBytes);
+    uint8* Data = PackedCacheData.GetData() + Entry.Offset;
+    FMemory::Memcpy(Data, PackedGrid.CollapsedBits.GetData(), PackedGrid.CollapsedBits.Num() * sizeof(uint64));
+    Data += PackedGrid.CollapsedBits.Num() * sizeof(uint64);
+    FMemory::Memcpy(Data, PackedGrid.PossibleWords.GetData(), PackedGrid.PossibleWords.Num() * sizeof(uint64));
+    Data += PackedGrid.PossibleWords.Num() * sizeof(uint64);
+    FMemory::Memcpy(Data, &HistoryCount, sizeof(int32));
+    Data += sizeof(int32);
+    FMemory::Memcpy(Data, PackedGrid.CollapseHistory.GetData(), HistoryCount * sizeof(int32));
+}
+
+TSharedPtr<const FWFCPackedGridCache> UWFCPreProcessCache::DecodePackedGrid(const FWFCPackedCacheEntry& Entry) const
+{
+    TSharedRef<FWFCPackedGridCache> PackedGrid = MakeShared<FWFCPackedGridCache>();
+    InitPackedGrid(*PackedGrid, Entry.GridSize, Entry.TileCount);
+
+    const int64 BitsBytes = PackedGrid->CollapsedBits.Num() * sizeof(uint64);
+    const int64 WordsBytes = PackedGrid->PossibleWords.Num() * sizeof(uint64);
+    if (Entry.Offset < 0 || Entry.NumBytes < BitsBytes + WordsBytes + static_cast<int64>(sizeof(int32)) ||
+        static_cast<int64>(Entry.Offset) + Entry.NumBytes > PackedCacheData.Num())
     {
-        TempCore.CollapseCellTo(Coord, 0);
-        TempCore.PropagateConstraints();
+        UE_LOG(LogTemp, Warning, TEXT("WFCPreProcessCache: Packed cache for %s is corrupted"), *Entry.GridSize.ToString());
+        return nullptr;
     }
 
-    const TMap<FWFCCoordinate, FWFCCell>& ProcessedGrid = TempCore.GetGrid();
-    for (const auto& [Coord, Cell] : ProcessedGrid)
+    const uint8* Data = PackedCacheData.GetData() + Entry.Offset;
+    FMemory::Memcpy(PackedGrid->CollapsedBits.GetData(), Data, BitsBytes);
+    Data += BitsBytes;
+    FMemory::Memcpy(PackedGrid->PossibleWords.GetData(), Data, WordsBytes);
+    Data += WordsBytes;
+
+    int32 HistoryCount = 0;
+    FMemory::Memcpy(&HistoryCount, Data, sizeof(int32));
+    Data += sizeof(int32);
+    if (HistoryCount < 0 || BitsBytes + WordsBytes + (1 + static_cast<int64>(HistoryCount)) * static_cast<int64>(sizeof(int32)) != Entry.NumBytes)
     {
-        CacheData.CachedGrid.Add(Coord, FWFCCachedCellData(Cell, TileSet->GetTileCount()));
+        UE_LOG(LogTemp, Warning, TEXT("WFCPreProcessCache: Packed cache for %s is corrupted"), *Entry.GridSize.ToString());
+        return nullptr;
     }
-    return CacheData;
+    PackedGrid->CollapseHistory.SetNumUninitialized(HistoryCount);
+    FMemory::Memcpy(PackedGrid->CollapseHistory.GetData(), Data, HistoryCount * sizeof(int32));
+    return PackedGrid;
 }
 
-bool UWFCPreProcessCache::IsBoundaryCoordinate(const FWFCCoordinate& Coord, const FIntVector& GridSize)
+TSharedPtr<const FWFCPackedGridCache> UWFCPreProcessCache::FindPackedGrid(const FIntVector& GridSize)
 {
-    return Coord.X == 0 || Coord.X == GridSize.X - 1 ||
-           Coord.Y == 0 || Coord.Y == GridSize.Y - 1 ||
-           Coord.Z == 0 || Coord.Z == GridSize.Z - 1;
+    //旧资产只有DataTable，第一次使用时转换成打包格式
+    if (PackedEntries.Num() == 0 && !bCacheLoaded)
+    {
+        LoadCacheFromDataTable();
+    }
+
+    FScopeLock Lock(&DecodedGridsLock);
+    if (const TSharedPtr<const FWFCPackedGridCache>* Found = DecodedGrids.Find(GridSize))
+    {
+        return *Found;
+    }
+
+    const FWFCPackedCacheEntry* Entry = PackedEntries.FindByPredicate([&GridSize](const FWFCPackedCacheEntry& Candidate)
+    {
+        return Candidate.GridSize == GridSize;
+    });
+    if (!Entry)
+    {
+        return nullptr;
+    }
+
+    TSharedPtr<const FWFCPackedGridCache> Decoded = DecodePackedGrid(*Entry);
+    if (Decoded)
+    {
+        DecodedGrids.Add(GridSize, Decoded);
+    }
+    return Decoded;
 }
 
-FName UWFCPreProcessCache::GetRowNameForGridSize(const FIntVector& GridSize)
+FWFCPackedGridCache UWFCPreProcessCache::PackCacheData(const FIntVector& GridSize,
+                                                       const TMap<FWFCCoordinate, FWFCCachedCellData>& CachedGrid,
+                                                       const TArray<FWFCCoordinate>& CachedCollapseHistory)
 {
-    return FName(*FString::Printf(TEXT("Grid_%d_%d_%d"), GridSize.X, GridSize.Y, GridSize.Z));
+    int32 TileCount = 0;
+    for (const auto& [Coord, CachedCell] : CachedGrid)
+    {
+        TileCount = FMath::Max(TileCount, CachedCell.PossibleTiles.Num());
+    }
+
+    FWFCPackedGridCache PackedGrid;
+    InitPackedGrid(PackedGrid, GridSize, TileCount);
+    for (const auto& [Coord, CachedCell] : CachedGrid)
+    {
+        if (Coord.X < 0 || Coord.X >= GridSize.X || Coord.Y < 0 || Coord.Y >= GridSize.Y || Coord.Z < 0 || Coord.Z >= GridSize.Z)
+        {
+            continue;
+        }
+
+        const int32 CellIndex = GetLinearIndex(Coord, GridSize);
+        uint64* Words = PackedGrid.PossibleWords.GetData() + CellIndex * PackedGrid.WordsPerCell;
+        for (int32 i = 0; i < CachedCell.PossibleTiles.Num(); i++)
+        {
+            if (CachedCell.PossibleTiles[i])
+            {
+                Words[i / 64] |= 1ull << (i % 64);
+            }
+        }
+        if (CachedCell.bCollapsed)
+        {
+            PackedGrid.CollapsedBits[CellIndex / 64] |= 1ull << (CellIndex % 64);
+        }
+    }
+
+    for (const FWFCCoordinate& Coord : CachedCollapseHistory)
+    {
+        PackedGrid.CollapseHistory.Add(GetLinearIndex(Coord, GridSize));
+    }
+    return PackedGrid;
 }
 
+void UWFCPreProcessCache::UnpackCacheData(const FWFCPackedGridCache& PackedGrid, FWFCPreProcessCacheData& OutCacheData)
+{
+    OutCacheData = FWFCPreProcessCacheData();
+    OutCacheData.GridSize = PackedGrid.GridSize;
+
+    for (int32 CellIndex = 0; CellIndex < PackedGrid.GetNumCells(); CellIndex++)
+    {
+        FWFCCachedCellData CachedCell;
+        CachedCell.PossibleTiles.SetNum(PackedGrid.TileCount);
+        const uint64* Words = PackedGrid.GetCellWords(CellIndex);
+        for (int32 i = 0; i < PackedGrid.TileCount; i++)
+        {
+            CachedCell.PossibleTiles[i] = (Words[i / 64] >> (i % 64)) & 1ull;
+        }
+        CachedCell.bCollapsed = PackedGrid.IsCollapsed(CellIndex);
+        CachedCell.CollapsedTileIndex = CachedCell.bCollapsed ? CachedCell.PossibleTiles.Find(true) : -1;
+        if (CachedCell.bCollapsed)
+        {
+            OutCacheData.CachedTileInstanceCounts.FindOrAdd(CachedCell.CollapsedTileIndex, 0)++;
+        }
+        OutCacheData.CachedGrid.Add(GetCoordinate(CellIndex, PackedGrid.GridSize), CachedCell);
+    }
+
+    for (const int32 CellIndex : PackedGrid.CollapseHistory)
+    {
+        OutCacheData.CachedCollapseHistory.Add(GetCoordinate(CellIndex, PackedGrid.GridSize));
+    }
+}
+
+//导出为DataTable便于在编辑器中查看，运行时只读取打包数据
 void UWFCPreProcessCache::SaveCacheToDataTable()
 {
     if (!CacheDataTable)
@@ -133,26 +307,37 @@ void UWFCPreProcessCache::SaveCacheToDataTable()
 #if WITH_EDITOR
     CacheDataTable->EmptyTable();
 
-    for (const auto& [GridSize, CacheData] : CacheMap)
+    for (const FWFCPackedCacheEntry& Entry : PackedEntries)
     {
-        FName RowName = GetRowNameForGridSize(GridSize);
+        TSharedPtr<const FWFCPackedGridCache> PackedGrid = DecodePackedGrid(Entry);
+        if (!PackedGrid)
+        {
+            continue;
+        }
+
+        FWFCPreProcessCacheData CacheData;
+        UnpackCacheData(*PackedGrid, CacheData);
+
+        FName RowName = GetRowNameForGridSize(Entry.GridSize);
         FWFCPreProcessCacheTableRow NewRow;
         
         NewRow.GridSize = CacheData.GridSize;
-        NewRow.CachedGrid = CacheData.CachedGrid;
-        NewRow.CachedTileInstanceCounts = CacheData.CachedTileInstanceCounts;
-        NewRow.CachedCollapseHistory = CacheData.CachedCollapseHistory;
+        NewRow.CachedGrid = MoveTemp(CacheData.CachedGrid);
+        NewRow.CachedTileInstanceCounts = MoveTemp(CacheData.CachedTileInstanceCounts);
+        NewRow.CachedCollapseHistory = MoveTemp(CacheData.CachedCollapseHistory);
         
         CacheDataTable->AddRow(RowName, NewRow);
     }
 
     MarkPackageDirty();
-    UE_LOG(LogTemp, Log, TEXT("WFCPreProcessCache: Saved %d cache entries to DataTable"), CacheMap.Num());
+    UE_LOG(LogTemp, Log, TEXT("WFCPreProcessCache: Saved %d cache entries to DataTable"), PackedEntries.Num());
 #endif
 }
 
+//把旧版DataTable中的缓存转换为打包格式
 bool UWFCPreProcessCache::LoadCacheFromDataTable()
 {
+    FScopeLock Lock(&DecodedGridsLock);
     if (bCacheLoaded)
     {
         return true;
@@ -164,7 +349,9 @@ bool UWFCPreProcessCache::LoadCacheFromDataTable()
         return false;
     }
 
-    CacheMap.Empty();
+    PackedEntries.Empty();
+    PackedCacheData.Empty();
+    DecodedGrids.Empty();
     TArray<FName> RowNames = CacheDataTable->GetRowNames();
 
     for (const FName& RowName : RowNames)
@@ -175,39 +362,35 @@ bool UWFCPreProcessCache::LoadCacheFromDataTable()
             continue;
         }
 
-        FWFCPreProcessCacheData CacheData;
-        CacheData.GridSize = Row->GridSize;
-        CacheData.CachedGrid = Row->CachedGrid;
-        CacheData.CachedTileInstanceCounts = Row->CachedTileInstanceCounts;
-        CacheData.CachedCollapseHistory = Row->CachedCollapseHistory;
-        
-        CacheMap.Add(Row->GridSize, CacheData);
+        AddPackedGrid(PackCacheData(Row->GridSize, Row->CachedGrid, Row->CachedCollapseHistory));
     }
 
     bCacheLoaded = true;
-    UE_LOG(LogTemp, Log, TEXT("WFCPreProcessCache: Loaded %d cache entries from DataTable"), CacheMap.Num());
+    UE_LOG(LogTemp, Log, TEXT("WFCPreProcessCache: Converted %d cache entries from DataTable (%d bytes)"),
+           PackedEntries.Num(), PackedCacheData.Num());
     return true;
 }
 
 bool UWFCPreProcessCache::GetCacheForGridSize(const FIntVector& GridSize, FWFCPreProcessCacheData& OutCacheData)
 {
-    if (!bCacheLoaded)
-    {
-        LoadCacheFromDataTable();
-    }
-
-    if (const FWFCPreProcessCacheData* Found = CacheMap.Find(GridSize))
+    TSharedPtr<const FWFCPackedGridCache> PackedGrid = FindPackedGrid(GridSize);
+    if (!PackedGrid)
     {
-        OutCacheData = *Found;
-        return true;
+        return false;
     }
 
-    return false;
+    UnpackCacheData(*PackedGrid, OutCacheData);
+    return true;
 }
 
 void UWFCPreProcessCache::ClearCache()
 {
-    CacheMap.Empty();
+    {
+        FScopeLock Lock(&DecodedGridsLock);
+        DecodedGrids.Empty();
+    }
+    PackedEntries.Empty();
+    PackedCacheData.Empty();
     bCacheLoaded = false;
     
     if (CacheDataTable)
@@ -218,4 +401,4 @@ void UWFCPreProcessCache::ClearCache()
 #endif
         UE_LOG(LogTemp, Log, TEXT("WFCPreProcessCache: Cache cleared"));
     }
-}
\ No newline at end of file
+}
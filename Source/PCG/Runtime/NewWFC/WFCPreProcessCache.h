@@ -29,12 +29,13 @@ struct PCG_API FWFCCachedCellData
 
     FWFCCachedCellData() = default;
     
-    FWFCCachedCellData(const FWFCCell& Cell, int32 TileCount)
+    FWFCCachedCellData(const FWFCGrid& Grid, int32 CellIndex)
     {
-        PossibleTiles.SetNum(TileCount);
-        for (int32 i = 0; i < TileCount; i++)
+        const FWFCCell& Cell = Grid[CellIndex];
+        PossibleTiles.SetNum(Grid.GetTileCount());
+        for (int32 i = 0; i < PossibleTiles.Num(); i++)
         {
-            PossibleTiles[i] = Cell.PossibleTiles[i];
+            PossibleTiles[i] = Grid.CanPlace(CellIndex, i);
         }
         bCollapsed = Cell.bCollapsed;
         CollapsedTileIndex = Cell.CollapsedTileIndex;
@@ -82,6 +83,41 @@ struct PCG_API FWFCPreProcessCacheTableRow : public FTableRowBase
     FWFCPreProcessCacheTableRow() = default;
 };
 
+//单个网格尺寸在PackedCacheData中的位置
+USTRUCT()
+struct PCG_API FWFCPackedCacheEntry
+{
+    GENERATED_BODY()
+
+    UPROPERTY()
+    FIntVector GridSize = FIntVector::ZeroValue;
+
+    UPROPERTY()
+    int32 TileCount = 0;
+
+    UPROPERTY()
+    int32 Offset = 0;
+
+    UPROPERTY()
+    int32 NumBytes = 0;
+};
+
+//解码后的单个尺寸缓存：每格每瓦片一位，按FWFCGrid的线性下标排列
+struct PCG_API FWFCPackedGridCache
+{
+    FIntVector GridSize = FIntVector::ZeroValue;
+    int32 TileCount = 0;
+    int32 WordsPerCell = 0;
+    TArray<uint64> CollapsedBits;
+    TArray<uint64> PossibleWords;
+    //坍缩顺序，存格子下标
+    TArray<int32> CollapseHistory;
+
+    int32 GetNumCells() const { return GridSize.X * GridSize.Y * GridSize.Z; }
+    bool IsCollapsed(int32 CellIndex) const { return (CollapsedBits[CellIndex / 64] >> (CellIndex % 64)) & 1ull; }
+    const uint64* GetCellWords(int32 CellIndex) const { return PossibleWords.GetData() + CellIndex * WordsPerCell; }
+};
+
 UCLASS(BlueprintType)
 class PCG_API UWFCPreProcessCache : public UDataAsset
 {
@@ -104,7 +140,15 @@ public:
     int32 GridHeight = 7;
 
 private:
-    TMap<FIntVector, FWFCPreProcessCacheData> CacheMap;
+    UPROPERTY()
+    TArray<FWFCPackedCacheEntry> PackedEntries;
+
+    //所有尺寸的打包数据连续存放，按需解码
+    UPROPERTY()
+    TArray<uint8> PackedCacheData;
+
+    FCriticalSection DecodedGridsLock;
+    TMap<FIntVector, TSharedPtr<const FWFCPackedGridCache>> DecodedGrids;
     bool bCacheLoaded = false;
 
 public:
@@ -126,8 +170,15 @@ public:
     UFUNCTION(BlueprintCallable, CallInEditor)
     void CreateCacheDataTable();
 
+    //线程安全，第一次请求某尺寸时才从PackedCacheData解码
+    TSharedPtr<const FWFCPackedGridCache> FindPackedGrid(const FIntVector& GridSize);
+
 private:
-    FWFCPreProcessCacheData GenerateCacheForGridSize(const FIntVector& GridSize);
-    bool IsBoundaryCoordinate(const FWFCCoordinate& Coord, const FIntVector& GridSize);
+    FWFCPackedGridCache GenerateCacheForGridSize(const FIntVector& GridSize);
+    void AddPackedGrid(const FWFCPackedGridCache& PackedGrid);
+    TSharedPtr<const FWFCPackedGridCache> DecodePackedGrid(const FWFCPackedCacheEntry& Entry) const;
+    static FWFCPackedGridCache PackCacheData(const FIntVector& GridSize, const TMap<FWFCCoordinate, FWFCCachedCellData>& CachedGrid,
+                                             const TArray<FWFCCoordinate>& CachedCollapseHistory);
+    static void UnpackCacheData(const FWFCPackedGridCache& PackedGrid, FWFCPreProcessCacheData& OutCacheData);
     FName GetRowNameForGridSize(const FIntVector& GridSize);
 };
\ No newline at end of file
@@ -0,0 +1,339 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "WFCReplay.h"
+
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace
+{
+	constexpr uint32 ReplayMagic = 0x50524657; //"WFRP"
+	constexpr uint32 ReplayVersion = 1;
+
+	struct FReplayHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint32 TileSetHash;
+		int32 NumTiles;
+		int32 GenerationSeed;
+		uint32 ResultHash;
+		int32 bSuccess;
+		int32 NumLearnedBans;
+		int32 NumAttempts;
+		int32 NumDecisions;
+	};
+
+	struct FConfigHeader
+	{
+		FIntVector GridSize;
+		int32 bPeriodicBoundary;
+		int32 GenerationMode;
+		int32 PropagatorMode;
+		int32 MaxIterations;
+		int32 RandomSeed;
+		int32 bEnableBacktracking;
+		int32 BacktrackingDepth;
+		int32 MaxBacktracks;
+		int32 bEnableBackjumping;
+		int32 ParallelAttempts;
+		int32 ChunkSize;
+		int32 ChunkOverlap;
+		int32 bShowEmptyTiles;
+		int32 NumConstraints;
+	};
+
+	struct FConstraintHeader
+	{
+		int32 NumRequiredPositions;
+		int32 NumForbiddenPositions;
+		int32 NumAllowedTiles;
+		int32 NumForbiddenTiles;
+		int32 MinLayer;
+		int32 MaxLayer;
+		int32 MinInstances;
+		int32 MaxInstances;
+	};
+
+	void WriteBytes(TArray<uint8>& Blob, const void* Data, int64 Size)
+	{
+		const int32 Offset = Blob.AddUninitialized(Size);
+		FMemory::Memcpy(Blob.GetData() + Offset, Data, Size);
+	}
+
+	template <typename T>
+	void WriteArray(TArray<uint8>& Blob, const TArray<T>& Array)
+	{
+		WriteBytes(Blob, Array.GetData(), Array.Num() * sizeof(T));
+	}
+
+	void WriteString(TArray<uint8>& Blob, const FString& String)
+	{
+		FTCHARToUTF8 Utf8(*String);
+		const int32 Length = Utf8.Length();
+		WriteBytes(Blob, &Length, sizeof(Length));
+		WriteBytes(Blob, Utf8.Get(), Length);
+	}
+
+	bool ReadBytes(const TArray<uint8>& Blob, int64& Offset, void* Data, int64 Size)
+	{
+		if (Size < 0 || Offset + Size > Blob.Num())
+		{
+			return false;
+		}
+		FMemory::Memcpy(Data, Blob.GetData() + Offset, Size);
+		Offset += Size;
+		return true;
+	}
+
+	template <typename T>
+	bool ReadArray(const TArray<uint8>& Blob, int64& Offset, TArray<T>& Array, int32 Num)
+	{
+		if (Num < 0)
+		{
+			return false;
+		}
+		Array.SetNumUninitialized(Num);
+		return ReadBytes(Blob, Offset, Array.GetData(), Num * sizeof(T));
+	}
+
+	bool ReadString(const TArray<uint8>& Blob, int64& Offset, FString& OutString)
+	{
+		int32 Length = 0;
+		if (!ReadBytes(Blob, Offset, &Length, sizeof(Length)) || Length < 0 || Offset + Length > Blob.Num())
+		{
+			return false;
+		}
+		FUTF8ToTCHAR Converted(reinterpret_cast<const ANSICHAR*>(Blob.GetData() + Offset), Length);
+		OutString = FString(Converted.Length(), Converted.Get());
+		Offset += Length;
+		return true;
+	}
+
+	void WriteConfiguration(TArray<uint8>& Blob, const FWFCConfiguration& Config)
+	{
+		FConfigHeader Header;
+		Header.GridSize = Config.GridSize;
+		Header.bPeriodicBoundary = Config.bPeriodicBoundary;
+		Header.GenerationMode = static_cast<int32>(Config.GenerationMode);
+		Header.PropagatorMode = static_cast<int32>(Config.PropagatorMode);
+		Header.MaxIterations = Config.MaxIterations;
+		Header.RandomSeed = Config.RandomSeed;
+		Header.bEnableBacktracking = Config.bEnableBacktracking;
+		Header.BacktrackingDepth = Config.BacktrackingDepth;
+		Header.MaxBacktracks = Config.MaxBacktracks;
+		Header.bEnableBackjumping = Config.bEnableBackjumping;
+		Header.ParallelAttempts = Config.ParallelAttempts;
+		Header.ChunkSize = Config.ChunkSize;
+		Header.ChunkOverlap = Config.ChunkOverlap;
+		Header.bShowEmptyTiles = Config.bShowEmptyTiles;
+		Header.NumConstraints = Config.Constraints.Num();
+		WriteBytes(Blob, &Header, sizeof(Header));
+
+		for (const FWFCGenerationConstraint& Constraint : Config.Constraints)
+		{
+			WriteString(Blob, Constraint.ConstraintName);
+
+			FConstraintHeader ConstraintHeader;
+			ConstraintHeader.NumRequiredPositions = Constraint.RequiredPositions.Num();
+			ConstraintHeader.NumForbiddenPositions = Constraint.ForbiddenPositions.Num();
+			ConstraintHeader.NumAllowedTiles = Constraint.AllowedTileIndices.Num();
+			ConstraintHeader.NumForbiddenTiles = Constraint.ForbiddenTileIndices.Num();
+			ConstraintHeader.MinLayer = Constraint.MinLayer;
+			ConstraintHeader.MaxLayer = Constraint.MaxLayer;
+			ConstraintHeader.MinInstances = Constraint.MinInstances;
+			ConstraintHeader.MaxInstances = Constraint.MaxInstances;
+			WriteBytes(Blob, &ConstraintHeader, sizeof(ConstraintHeader));
+
+			WriteArray(Blob, Constraint.RequiredPositions);
+			WriteArray(Blob, Constraint.ForbiddenPositions);
+			WriteArray(Blob, Constraint.AllowedTileIndices);
+			WriteArray(Blob, Constraint.ForbiddenTileIndices);
+		}
+	}
+
+	bool ReadConfiguration(const TArray<uint8>& Blob, int64& Offset, FWFCConfiguration& OutConfig)
+	{
+		FConfigHeader Header;
+		if (!ReadBytes(Blob, Offset, &Header, sizeof(Header)) || Header.NumConstraints < 0)
+		{
+			return false;
+		}
+
+		OutConfig = FWFCConfiguration();
+		OutConfig.GridSize = Header.GridSize;
+		OutConfig.bPeriodicBoundary = Header.bPeriodicBoundary != 0;
+		OutConfig.GenerationMode = static_cast<EWFCGenerationMode>(Header.GenerationMode);
+		OutConfig.PropagatorMode = static_cast<EWFCPropagatorMode>(Header.PropagatorMode);
+		OutConfig.MaxIterations = Header.MaxIterations;
+		OutConfig.RandomSeed = Header.RandomSeed;
+		OutConfig.bEnableBacktracking = Header.bEnableBacktracking != 0;
+		OutConfig.BacktrackingDepth = Header.BacktrackingDepth;
+		OutConfig.MaxBacktracks = Header.MaxBacktracks;
+		OutConfig.bEnableBackjumping = Header.bEnableBackjumping != 0;
+		OutConfig.ParallelAttempts = Header.ParallelAttempts;
+		OutConfig.ChunkSize = Header.ChunkSize;
+		OutConfig.ChunkOverlap = Header.ChunkOverlap;
+		OutConfig.bShowEmptyTiles = Header.bShowEmptyTiles != 0;
+
+		OutConfig.Constraints.SetNum(Header.NumConstraints);
+		for (FWFCGenerationConstraint& Constraint : OutConfig.Constraints)
+		{
+			FConstraintHeader ConstraintHeader;
+			bool bRead = ReadString(Blob, Offset, Constraint.ConstraintName);
+			bRead = bRead && ReadBytes(Blob, Offset, &ConstraintHeader, sizeof(ConstraintHeader));
+			bRead = bRead && ReadArray(Blob, Offset, Constraint.RequiredPositions, ConstraintHeader.NumRequiredPositions);
+			bRead = bRead && ReadArray(Blob, Offset, Constraint.ForbiddenPositions, ConstraintHeader.NumForbiddenPositions);
+			bRead = bRead && ReadArray(Blob, Offset, Constraint.AllowedTileIndices, ConstraintHeader.NumAllowedTiles);
+			bRead = bRead && ReadArray(Blob, Offset, Constraint.ForbiddenTileIndices, ConstraintHeader.NumForbiddenTiles);
+			if (!bRead)
+			{
+				return false;
+			}
+			Constraint.MinLayer = ConstraintHeader.MinLayer;
+			Constraint.MaxLayer = ConstraintHeader.MaxLayer;
+			Constraint.MinInstances = ConstraintHeader.MinInstances;
+			Constraint.MaxInstances = ConstraintHeader.MaxInstances;
+		}
+		return true;
+	}
+}
+
+void FWFCReplayLog::Reset()
+{
+	Config = FWFCConfiguration();
+	TileSetPath.Empty();
+	TileSetHash = 0;
+	NumTiles = 0;
+	GenerationSeed = 0;
+	LearnedBans.Reset();
+	Attempts.Reset();
+	Decisions.Reset();
+	ResultHash = 0;
+	bSuccess = false;
+}
+
+int32 FWFCReplayLog::FindFirstDivergence(const FWFCReplayLog& Other) const
+{
+	const int32 NumCommon = FMath::Min(Decisions.Num(), Other.Decisions.Num());
+	for (int32 Index = 0; Index < NumCommon; Index++)
+	{
+		const FWFCReplayDecision& A = Decisions[Index];
+		const FWFCReplayDecision& B = Other.Decisions[Index];
+		if (A.CellIndex != B.CellIndex || A.TileIndex != B.TileIndex || A.RandomState != B.RandomState)
+		{
+			return Index;
+		}
+	}
+
+	if (Decisions.Num() != Other.Decisions.Num())
+	{
+		return NumCommon;
+	}
+
+	//决策相同但尝试划分不同时，在第一个不同尝试的起点处分歧
+	const int32 NumCommonAttempts = FMath::Min(Attempts.Num(), Other.Attempts.Num());
+	for (int32 Index = 0; Index < NumCommonAttempts; Index++)
+	{
+		if (Attempts[Index].Seed != Other.Attempts[Index].Seed ||
+			Attempts[Index].FirstDecision != Other.Attempts[Index].FirstDecision)
+		{
+			return FMath::Min(Attempts[Index].FirstDecision, Other.Attempts[Index].FirstDecision);
+		}
+	}
+	return Attempts.Num() == Other.Attempts.Num() ? INDEX_NONE : NumCommon;
+}
+
+void FWFCReplayLog::SaveToBlob(TArray<uint8>& OutBlob) const
+{
+	OutBlob.Reset();
+
+	FReplayHeader Header;
+	Header.Magic = ReplayMagic;
+	Header.Version = ReplayVersion;
+	Header.TileSetHash = TileSetHash;
+	Header.NumTiles = NumTiles;
+	Header.GenerationSeed = GenerationSeed;
+	Header.ResultHash = ResultHash;
+	Header.bSuccess = bSuccess;
+	Header.NumLearnedBans = LearnedBans.Num();
+	Header.NumAttempts = Attempts.Num();
+	Header.NumDecisions = Decisions.Num();
+	WriteBytes(OutBlob, &Header, sizeof(Header));
+
+	WriteArray(OutBlob, LearnedBans);
+	WriteArray(OutBlob, Attempts);
+	WriteArray(OutBlob, Decisions);
+
+	WriteString(OutBlob, TileSetPath);
+	WriteConfiguration(OutBlob, Config);
+}
+
+bool FWFCReplayLog::LoadFromBlob(const TArray<uint8>& Blob)
+{
+	Reset();
+
+	int64 Offset = 0;
+	FReplayHeader Header;
+	if (!ReadBytes(Blob, Offset, &Header, sizeof(Header)) || Header.Magic != ReplayMagic ||
+		Header.Version != ReplayVersion)
+	{
+		return false;
+	}
+
+	bool bRead = ReadArray(Blob, Offset, LearnedBans, Header.NumLearnedBans);
+	bRead = bRead && ReadArray(Blob, Offset, Attempts, Header.NumAttempts);
+	bRead = bRead && ReadArray(Blob, Offset, Decisions, Header.NumDecisions);
+	bRead = bRead && ReadString(Blob, Offset, TileSetPath);
+	bRead = bRead && ReadConfiguration(Blob, Offset, Config);
+	if (!bRead || Offset != Blob.Num())
+	{
+		Reset();
+		return false;
+	}
+
+	TileSetHash = Header.TileSetHash;
+	NumTiles = Header.NumTiles;
+	GenerationSeed = Header.GenerationSeed;
+	ResultHash = Header.ResultHash;
+	bSuccess = Header.bSuccess != 0;
+	return true;
+}
+
+bool FWFCReplayLog::SaveToFile(const FString& Path) const
+{
+	TArray<uint8> Blob;
+	SaveToBlob(Blob);
+	if (!FFileHelper::SaveArrayToFile(Blob, *Path))
+	{
+		UE_LOG(LogTemp, Error, TEXT("WFCReplay: Failed to write %s"), *Path);
+		return false;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("WFCReplay: Wrote %d decisions in %d attempts to %s"), Decisions.Num(), Attempts.Num(),
+	       *Path);
+	return true;
+}
+
+bool FWFCReplayLog::LoadFromFile(const FString& Path)
+{
+	TArray<uint8> Blob;
+	if (!FFileHelper::LoadFileToArray(Blob, *Path))
+	{
+		UE_LOG(LogTemp, Error, TEXT("WFCReplay: Failed to read %s"), *Path);
+		return false;
+	}
+
+	if (!LoadFromBlob(Blob))
+	{
+		UE_LOG(LogTemp, Error, TEXT("WFCReplay: %s is not a valid replay (version %d expected)"), *Path, ReplayVersion);
+		return false;
+	}
+	return true;
+}
+
+FString FWFCReplayLog::CreateReplayPath()
+{
+	const FString Directory = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("WFCReplays"));
+	return FPaths::CreateTempFilename(*Directory, TEXT("WFCReplay-"), TEXT(".wfcreplay"));
+}
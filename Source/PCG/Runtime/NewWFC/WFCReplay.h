@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "WFCTypes.h"
+
+//一次随机选择：RandomState为选择前的随机流状态，TileIndex为INDEX_NONE时表示没有可选瓦片
+struct FWFCReplayDecision
+{
+    int32 CellIndex;
+    int32 TileIndex;
+    int32 RandomState;
+};
+
+//一次尝试的种子及其第一条决策的下标
+struct FWFCReplayAttempt
+{
+    int32 Seed;
+    int32 FirstDecision;
+};
+
+struct FWFCReplayBan
+{
+    int32 CellIndex;
+    int32 TileIndex;
+};
+
+//一次Generate的重放日志，配合同内容的瓦片集可以逐位重现生成过程
+//分块生成的子求解器不记录决策，只能按ResultHash校验结果
+struct PCG_API FWFCReplayLog
+{
+    FWFCConfiguration Config;
+    FString TileSetPath;
+    uint32 TileSetHash = 0;
+    int32 NumTiles = 0;
+    //Generate开始时的随机流状态，第0次尝试直接使用，之后的尝试由它派生
+    int32 GenerationSeed = 0;
+    //开始前已学到的禁用，对同一配置的后续生成同样生效
+    TArray<FWFCReplayBan> LearnedBans;
+    TArray<FWFCReplayAttempt> Attempts;
+    TArray<FWFCReplayDecision> Decisions;
+    uint32 ResultHash = 0;
+    bool bSuccess = false;
+
+    void Reset();
+
+    //返回第一条不一致的决策下标，完全一致时返回INDEX_NONE
+    int32 FindFirstDivergence(const FWFCReplayLog& Other) const;
+
+    //定长头后按原始字节存放决策，配置与约束逐项写入
+    void SaveToBlob(TArray<uint8>& OutBlob) const;
+    bool LoadFromBlob(const TArray<uint8>& Blob);
+    bool SaveToFile(const FString& Path) const;
+    bool LoadFromFile(const FString& Path);
+
+    //Saved/WFCReplays下不重名的文件
+    static FString CreateReplayPath();
+};
@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "WFCResultLibrary.h"
+
+int32 UWFCResultLibrary::GetTileAt(const FWFCGenerationResult& Result, const FWFCCoordinate& Coord)
+{
+	return Result.GetTileAt(Coord);
+}
+
+FIntVector UWFCResultLibrary::GetGridSize(const FWFCGenerationResult& Result)
+{
+	return Result.TileAssignments ? Result.TileAssignments->GridSize : FIntVector::ZeroValue;
+}
+
+int32 UWFCResultLibrary::GetPlacedTileCount(const FWFCGenerationResult& Result)
+{
+	return Result.GetPlacedTileCount();
+}
+
+TMap<FWFCCoordinate, int32> UWFCResultLibrary::GetTileAssignments(const FWFCGenerationResult& Result)
+{
+	TMap<FWFCCoordinate, int32> Assignments;
+	Assignments.Reserve(Result.GetPlacedTileCount());
+	Result.ForEachPlacedTile([&Assignments](const FWFCCoordinate& Coord, int32 TileIndex)
+	{
+		Assignments.Add(Coord, TileIndex);
+	});
+	return Assignments;
+}
+
+TArray<FWFCCoordinate> UWFCResultLibrary::GetFailedPositions(const FWFCGenerationResult& Result)
+{
+	TArray<FWFCCoordinate> FailedPositions;
+	if (!Result.TileAssignments)
+	{
+		return FailedPositions;
+	}
+
+	const FWFCTileAssignments& Assignments = *Result.TileAssignments;
+	FailedPositions.Reserve(Assignments.Num() - Assignments.NumPlaced);
+	for (int32 Index = 0; Index < Assignments.Num(); Index++)
+	{
+		if (Assignments.TileIndices[Index] == INDEX_NONE)
+		{
+			FailedPositions.Add(Assignments.GetCoordinate(Index));
+		}
+	}
+	return FailedPositions;
+}
@@ -0,0 +1,33 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "WFCTypes.h"
+#include "WFCResultLibrary.generated.h"
+
+//FWFCGenerationResult的瓦片数据只在C++中以共享指针保存，Blueprint通过这里读取
+UCLASS()
+class PCG_API UWFCResultLibrary : public UBlueprintFunctionLibrary
+{
+    GENERATED_BODY()
+
+public:
+    //格子未坍缩或超出网格时返回-1
+    UFUNCTION(BlueprintPure, Category = "WFC|Result")
+    static int32 GetTileAt(const FWFCGenerationResult& Result, const FWFCCoordinate& Coord);
+
+    UFUNCTION(BlueprintPure, Category = "WFC|Result")
+    static FIntVector GetGridSize(const FWFCGenerationResult& Result);
+
+    UFUNCTION(BlueprintPure, Category = "WFC|Result")
+    static int32 GetPlacedTileCount(const FWFCGenerationResult& Result);
+
+    //每次调用都会构建新的Map，循环中应先保存结果
+    UFUNCTION(BlueprintPure, Category = "WFC|Result")
+    static TMap<FWFCCoordinate, int32> GetTileAssignments(const FWFCGenerationResult& Result);
+
+    UFUNCTION(BlueprintPure, Category = "WFC|Result")
+    static TArray<FWFCCoordinate> GetFailedPositions(const FWFCGenerationResult& Result);
+};
@@ -0,0 +1,133 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//按64位字打包的瓦片集合，传播时按整字做与/或运算
+class FWFCTileMask
+{
+public:
+    static constexpr int32 BitsPerWord = 64;
+
+    FWFCTileMask() = default;
+    FWFCTileMask(bool bValue, int32 InNumBits) { Init(bValue, InNumBits); }
+
+    static int32 GetNumWords(int32 InNumBits) { return (InNumBits + BitsPerWord - 1) / BitsPerWord; }
+
+    void Init(bool bValue, int32 InNumBits)
+    {
+        NumBits = InNumBits;
+        Words.Reset();
+        Words.Init(bValue ? ~0ull : 0ull, GetNumWords(InNumBits));
+        ClearPaddingBits();
+    }
+
+    void Empty()
+    {
+        NumBits = 0;
+        Words.Empty();
+    }
+
+    int32 Num() const { return NumBits; }
+    int32 NumWords() const { return Words.Num(); }
+    bool IsValidIndex(int32 Index) const { return Index >= 0 && Index < NumBits; }
+
+    uint64* GetWords() { return Words.GetData(); }
+    const uint64* GetWords() const { return Words.GetData(); }
+
+    bool operator[](int32 Index) const
+    {
+        return (Words[Index / BitsPerWord] >> (Index % BitsPerWord)) & 1ull;
+    }
+
+    void Set(int32 Index, bool bValue)
+    {
+        const uint64 Bit = 1ull << (Index % BitsPerWord);
+        if (bValue)
+        {
+            Words[Index / BitsPerWord] |= Bit;
+        }
+        else
+        {
+            Words[Index / BitsPerWord] &= ~Bit;
+        }
+    }
+
+    void SetRange(int32 Index, int32 Count, bool bValue)
+    {
+        for (int32 i = Index; i < Index + Count; i++)
+        {
+            Set(i, bValue);
+        }
+    }
+
+    void SetAll(bool bValue)
+    {
+        for (uint64& Word : Words)
+        {
+            Word = bValue ? ~0ull : 0ull;
+        }
+        ClearPaddingBits();
+    }
+
+    int32 CountSetBits() const { return CountSetBits(Words.GetData(), Words.Num()); }
+    int32 FindFirstSetBit() const { return FindFirstSetBit(Words.GetData(), Words.Num()); }
+
+    static int32 CountSetBits(const uint64* InWords, int32 InNumWords)
+    {
+        int32 Count = 0;
+        for (int32 WordIndex = 0; WordIndex < InNumWords; WordIndex++)
+        {
+            Count += FMath::CountBits(InWords[WordIndex]);
+        }
+        return Count;
+    }
+
+    static int32 FindFirstSetBit(const uint64* InWords, int32 InNumWords)
+    {
+        for (int32 WordIndex = 0; WordIndex < InNumWords; WordIndex++)
+        {
+            if (InWords[WordIndex] != 0)
+            {
+                return WordIndex * BitsPerWord + static_cast<int32>(FMath::CountTrailingZeros64(InWords[WordIndex]));
+            }
+        }
+        return INDEX_NONE;
+    }
+
+    //依次对每个置位的下标调用Func
+    template <typename FuncType>
+    static void ForEachSetBit(const uint64* InWords, int32 InNumWords, FuncType&& Func)
+    {
+        for (int32 WordIndex = 0; WordIndex < InNumWords; WordIndex++)
+        {
+            uint64 Word = InWords[WordIndex];
+            while (Word != 0)
+            {
+                Func(WordIndex * BitsPerWord + static_cast<int32>(FMath::CountTrailingZeros64(Word)));
+                Word &= Word - 1;
+            }
+        }
+    }
+
+    template <typename FuncType>
+    void ForEachSetBit(FuncType&& Func) const
+    {
+        ForEachSetBit(Words.GetData(), Words.Num(), Forward<FuncType>(Func));
+    }
+
+private:
+    //超出NumBits的高位必须保持为0，否则计数和与运算结果会出错
+    void ClearPaddingBits()
+    {
+        const int32 UsedBits = NumBits % BitsPerWord;
+        if (UsedBits != 0 && Words.Num() > 0)
+        {
+            Words.Last() &= (1ull << UsedBits) - 1;
+        }
+    }
+
+    TArray<uint64, TInlineAllocator<2>> Words;
+    int32 NumBits = 0;
+};
@@ -1,4 +1,6 @@
 #include "WFCTileSet.h"
+#include "WFCCompiledTileSet.h"
+#include "UObject/ObjectSaveContext.h"
 
 void UWFCTileSet::ReadDatatable()
 {
@@ -30,6 +32,7 @@ void UWFCTileSet::ReadDatatable()
 			TileRuleSets[0].Tiles.Add(TileDefinition);
 		}
 		GenerateRotationVariants();
+		BakeCompiledRules();
 #if WITH_EDITOR
 			MarkPackageDirty();
 #endif
@@ -112,6 +115,16 @@ bool UWFCTileSet::AreSocketsCompatible(const FString& Socket1, const FString& So
 
 FWFCSocket UWFCTileSet::GetSocketDefinition(const FString& SocketName) const
 {
+	//SocketDefinitions可在蓝图中修改而查找表只在加载和编辑时重建，下标越界或名字不一致时退回线性查找
+	if (const int32* DefinitionIndex = SocketDefinitionLookup.Find(SocketName))
+	{
+		if (SocketDefinitions.IsValidIndex(*DefinitionIndex) &&
+			SocketDefinitions[*DefinitionIndex].SocketName.Equals(SocketName, ESearchCase::IgnoreCase))
+		{
+			return SocketDefinitions[*DefinitionIndex];
+		}
+	}
+
 	for (const FWFCSocket& SocketDef : SocketDefinitions)
 	{
 		if (SocketDef.SocketName.Equals(SocketName, ESearchCase::IgnoreCase))
@@ -241,32 +254,42 @@ void UWFCTileSet::GenerateRotationVariants()
 			Tiles.Add(RotatedTile);
 		}
 	}
-	for (int i = 0; i < Tiles.Num(); i++)
+	BuildSocketTable();
+
+	//同一方向上出现过的Socket两两查兼容矩阵，补全SocketDefinitions
+	TMap<FString, int32> DefinitionIndices;
+	for (int32 i = 0; i < SocketDefinitions.Num(); i++)
 	{
-		for (int d = 0; d < 6; d++)
+		DefinitionIndices.FindOrAdd(SocketDefinitions[i].SocketName, i);
+	}
+	for (int32 d = 0; d < 6; d++)
+	{
+		TArray<int32> DirectionSockets;
+		for (int32 i = 0; i < Tiles.Num(); i++)
+		{
+			DirectionSockets.AddUnique(GetTileSocketId(i, d));
+		}
+
+		for (int32 SocketA : DirectionSockets)
 		{
-			for (int j = 0; j < Tiles.Num(); j++)
+			for (int32 SocketB : DirectionSockets)
 			{
-				
-				if (AreSocketsCompatible(Tiles[i].Sockets[d], Tiles[j].Sockets[d]))
+				if (!AreSocketIdsCompatible(SocketA, SocketB))
 				{
-					int32 index;
-					if (HasSocket(Tiles[i].Sockets[d], index))
-					{
-						if (!SocketDefinitions[index].CompatibleSockets.Contains(Tiles[j].Sockets[d]))
-							SocketDefinitions[index].CompatibleSockets.Add(Tiles[j].Sockets[d]);
-					}
-					else
-					{
-						FWFCSocket newsocket;
-						newsocket.SocketName = Tiles[i].Sockets[d];
-						newsocket.CompatibleSockets.Add(Tiles[j].Sockets[d]);
-						SocketDefinitions.Add(newsocket);
-					}
+					continue;
 				}
+				int32* DefinitionIndex = DefinitionIndices.Find(SocketNames[SocketA]);
+				if (!DefinitionIndex)
+				{
+					FWFCSocket NewSocket;
+					NewSocket.SocketName = SocketNames[SocketA];
+					DefinitionIndex = &DefinitionIndices.Add(SocketNames[SocketA], SocketDefinitions.Add(NewSocket));
+				}
+				SocketDefinitions[*DefinitionIndex].CompatibleSockets.AddUnique(SocketNames[SocketB]);
 			}
 		}
 	}
+	RebuildSocketLookups();
 
 	UE_LOG(LogTemp, Log, TEXT("WFCTileSet: Generated rotation variants, total tiles: %d"), Tiles.Num());
 }
@@ -335,4 +358,138 @@ bool UWFCTileSet::HasSocket(const FString& SocketName, int32& outIndex) const
 		}
 	}
 	return false;
-}
\ No newline at end of file
+}
+
+void UWFCTileSet::PostLoad()
+{
+	Super::PostLoad();
+
+	if (!HasValidSocketTable())
+	{
+		BuildSocketTable();
+	}
+	else
+	{
+		RebuildSocketLookups();
+	}
+}
+
+#if WITH_EDITOR
+void UWFCTileSet::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+	BuildSocketTable();
+}
+
+void UWFCTileSet::PreSave(FObjectPreSaveContext ObjectSaveContext)
+{
+	Super::PreSave(ObjectSaveContext);
+	BakeCompiledRules();
+}
+#endif
+
+void UWFCTileSet::BuildSocketTable()
+{
+	SocketNames.Reset();
+	SocketIdLookup.Reset();
+	TileSocketIds.SetNumUninitialized(Tiles.Num() * 6);
+
+	for (int32 i = 0; i < Tiles.Num(); i++)
+	{
+		for (int32 d = 0; d < 6; d++)
+		{
+			const FString Socket = Tiles[i].GetSocket(static_cast<EWFCDirection>(d));
+			int32* SocketId = SocketIdLookup.Find(Socket);
+			if (!SocketId)
+			{
+				SocketId = &SocketIdLookup.Add(Socket, SocketNames.Add(Socket));
+			}
+			TileSocketIds[i * 6 + d] = *SocketId;
+		}
+	}
+
+	//只对去重后的Socket做一次字符串兼容判断
+	const int32 SocketCount = SocketNames.Num();
+	SocketMatrixWords = FMath::Max(1, (SocketCount + 63) / 64);
+	SocketCompatibilityMatrix.Reset();
+	SocketCompatibilityMatrix.SetNumZeroed(SocketCount * SocketMatrixWords);
+	for (int32 SocketA = 0; SocketA < SocketCount; SocketA++)
+	{
+		for (int32 SocketB = 0; SocketB < SocketCount; SocketB++)
+		{
+			if (AreSocketsCompatible(SocketNames[SocketA], SocketNames[SocketB]))
+			{
+				SocketCompatibilityMatrix[SocketA * SocketMatrixWords + SocketB / 64] |= 1ull << (SocketB % 64);
+			}
+		}
+	}
+
+	RebuildSocketLookups();
+}
+
+void UWFCTileSet::BakeCompiledRules()
+{
+	if (!HasValidSocketTable())
+	{
+		BuildSocketTable();
+	}
+
+	FWFCCompiledTileSet Compiled;
+	Compiled.Build(*this);
+	Compiled.ContentHash = FWFCCompiledTileSet::ComputeContentHash(*this);
+	Compiled.SaveToBlob(CompiledRulesBlob);
+
+	UE_LOG(LogTemp, Log, TEXT("WFCTileSet: Baked compiled rules for %d tiles (%d bytes)"),
+	       Tiles.Num(), CompiledRulesBlob.Num());
+}
+
+bool UWFCTileSet::HasValidSocketTable() const
+{
+	if (TileSocketIds.Num() != Tiles.Num() * 6 || SocketMatrixWords * 64 < SocketNames.Num() ||
+		SocketCompatibilityMatrix.Num() != SocketNames.Num() * SocketMatrixWords)
+	{
+		return false;
+	}
+
+	//Tiles被直接修改过而没有重建时，名字会对不上
+	for (int32 i = 0; i < Tiles.Num(); i++)
+	{
+		for (int32 d = 0; d < 6; d++)
+		{
+			const int32 SocketId = TileSocketIds[i * 6 + d];
+			if (!SocketNames.IsValidIndex(SocketId) ||
+				!SocketNames[SocketId].Equals(Tiles[i].GetSocket(static_cast<EWFCDirection>(d)), ESearchCase::IgnoreCase))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+int32 UWFCTileSet::FindSocketId(const FString& SocketName) const
+{
+	if (const int32* SocketId = SocketIdLookup.Find(SocketName))
+	{
+		return *SocketId;
+	}
+	return SocketIdLookup.Num() > 0 ? INDEX_NONE : SocketNames.IndexOfByPredicate([&SocketName](const FString& Name)
+	{
+		return Name.Equals(SocketName, ESearchCase::IgnoreCase);
+	});
+}
+
+void UWFCTileSet::RebuildSocketLookups()
+{
+	SocketIdLookup.Reset();
+	for (int32 i = 0; i < SocketNames.Num(); i++)
+	{
+		SocketIdLookup.FindOrAdd(SocketNames[i], i);
+	}
+
+	SocketDefinitionLookup.Reset();
+	for (int32 i = 0; i < SocketDefinitions.Num(); i++)
+	{
+		SocketDefinitionLookup.FindOrAdd(SocketDefinitions[i].SocketName, i);
+	}
+}
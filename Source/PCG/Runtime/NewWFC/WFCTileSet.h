@@ -77,7 +77,32 @@ public:
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
     FWFCConfiguration DefaultConfiguration;
 
+    //去重后的Socket名，下标即SocketId（名字不区分大小写）
+    UPROPERTY(VisibleAnywhere)
+    TArray<FString> SocketNames;
+
+    //[Tile * 6 + Dir] -> SocketId
+    UPROPERTY(VisibleAnywhere)
+    TArray<int32> TileSocketIds;
+
+    //SocketId两两兼容的位矩阵，每行SocketMatrixWords个字
+    UPROPERTY()
+    TArray<uint64> SocketCompatibilityMatrix;
+
+    UPROPERTY()
+    int32 SocketMatrixWords = 0;
+
+    //烘焙的FWFCCompiledTileSet二进制块，保存资产时刷新，运行时整块读取
+    UPROPERTY()
+    TArray<uint8> CompiledRulesBlob;
+
 public:
+    virtual void PostLoad() override;
+#if WITH_EDITOR
+    virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+    virtual void PreSave(FObjectPreSaveContext ObjectSaveContext) override;
+#endif
+
     UFUNCTION(BlueprintCallable, BlueprintPure)
     int32 GetTileCount() const { return Tiles.Num(); }
 
@@ -105,11 +130,35 @@ public:
     UFUNCTION(BlueprintCallable, CallInEditor)
     void GenerateRotationVariants();
 
+    //由Tiles重建SocketNames/TileSocketIds/兼容矩阵
+    UFUNCTION(BlueprintCallable, CallInEditor)
+    void BuildSocketTable();
+
+    //把编译后的规则写入CompiledRulesBlob
+    UFUNCTION(BlueprintCallable, CallInEditor)
+    void BakeCompiledRules();
+
+    bool HasValidSocketTable() const;
+    int32 FindSocketId(const FString& SocketName) const;
+    int32 GetSocketCount() const { return SocketNames.Num(); }
+    int32 GetTileSocketId(int32 TileIndex, int32 Direction) const { return TileSocketIds[TileIndex * 6 + Direction]; }
+
+    bool AreSocketIdsCompatible(int32 SocketA, int32 SocketB) const
+    {
+        return (SocketCompatibilityMatrix[SocketA * SocketMatrixWords + SocketB / 64] >> (SocketB % 64)) & 1ull;
+    }
+
 protected:
     FString RotateSocketName(const FString& SocketName, int32 RotationSteps) const;
     
     TArray<FString> RotateSockets(const TArray<FString>& OriginalSockets, int32 RotationSteps) const;
 
     bool HasSocket(const FString& SocketName, int32& outIndex) const;
+
+    void RebuildSocketLookups();
+
+    //运行时查找表，不序列化，PostLoad/BuildSocketTable时重建
+    TMap<FString, int32> SocketIdLookup;
+    TMap<FString, int32> SocketDefinitionLookup;
 };
 
@@ -45,6 +45,13 @@ enum class EWFCGenerationMode : uint8
     Custom = 99         UMETA(DisplayName = "Custom Order")
 };
 
+UENUM(BlueprintType)
+enum class EWFCPropagatorMode : uint8
+{
+    Bitset = 0          UMETA(DisplayName = "Bitset (AC-3)"),
+    SupportCount = 1    UMETA(DisplayName = "Support Count (AC-4)")
+};
+
 USTRUCT(BlueprintType)
 struct FWFCCoordinate
 {
@@ -228,6 +235,9 @@ struct FWFCConfiguration
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
     EWFCGenerationMode GenerationMode = EWFCGenerationMode::Random;
 
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    EWFCPropagatorMode PropagatorMode = EWFCPropagatorMode::Bitset;
+
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
     int32 MaxIterations = 1000;
 
@@ -237,8 +247,29 @@ struct FWFCConfiguration
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
     bool bEnableBacktracking = true;
 
+    //一次矛盾最多向上回退的层数
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = 1))
+    int32 BacktrackingDepth = 100;
+
+    //单次尝试中回退的总层数上限，超出后放弃本次尝试重新开始
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = 0))
+    int32 MaxBacktracks = 1000;
+
+    //按冲突集直接回退到导致矛盾的选择，并记住与选择无关的失败组合
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
-    int32 BacktrackingDepth = 10;
+    bool bEnableBackjumping = true;
+
+    //大于1时按批并行运行多个派生种子的尝试，取编号最小的成功结果
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = 1))
+    int32 ParallelAttempts = 1;
+
+    //大于0时把XY平面按ChunkSize分块，按棋盘格分四个阶段并行求解
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = 0))
+    int32 ChunkSize = 0;
+
+    //每块向外扩展的格数，扩展区内已求解的格子作为接缝约束
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = 1))
+    int32 ChunkOverlap = 2;
 
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
     TArray<FWFCGenerationConstraint> Constraints;
@@ -247,6 +278,76 @@ struct FWFCConfiguration
     bool bShowEmptyTiles = false;
 };
 
+//单次Generate的求解统计。每个求解器只由一个线程写入，并行与分块的子求解器在汇合后累加
+USTRUCT(BlueprintType)
+struct FWFCSolverStats
+{
+    GENERATED_BODY()
+
+    //位集模式为PropagateFrom次数，AC-4模式为处理的禁用数
+    UPROPERTY(BlueprintReadOnly)
+    int64 Propagations = 0;
+
+    //从格子中移除的瓦片数
+    UPROPERTY(BlueprintReadOnly)
+    int64 Bans = 0;
+
+    UPROPERTY(BlueprintReadOnly)
+    int64 QueuePushes = 0;
+
+    UPROPERTY(BlueprintReadOnly)
+    int32 Contradictions = 0;
+
+    UPROPERTY(BlueprintReadOnly)
+    int32 Backtracks = 0;
+
+    UPROPERTY(BlueprintReadOnly)
+    int32 Retries = 0;
+
+    void Accumulate(const FWFCSolverStats& Other)
+    {
+        Propagations += Other.Propagations;
+        Bans += Other.Bans;
+        QueuePushes += Other.QueuePushes;
+        Contradictions += Other.Contradictions;
+        Backtracks += Other.Backtracks;
+        Retries += Other.Retries;
+    }
+};
+
+//按FWFCGrid的线性格子顺序存放的瓦片下标，未坍缩的格子为INDEX_NONE
+//生成后只读，结果在线程、委托和可视化之间传递时只复制指针
+struct FWFCTileAssignments
+{
+    FIntVector GridSize = FIntVector::ZeroValue;
+    TArray<int32> TileIndices;
+    int32 NumPlaced = 0;
+
+    int32 Num() const { return TileIndices.Num(); }
+
+    int32 GetIndex(const FWFCCoordinate& Coord) const
+    {
+        if (Coord.X < 0 || Coord.X >= GridSize.X || Coord.Y < 0 || Coord.Y >= GridSize.Y ||
+            Coord.Z < 0 || Coord.Z >= GridSize.Z)
+        {
+            return INDEX_NONE;
+        }
+        return (Coord.X * GridSize.Y + Coord.Y) * GridSize.Z + Coord.Z;
+    }
+
+    FWFCCoordinate GetCoordinate(int32 Index) const
+    {
+        return FWFCCoordinate(Index / (GridSize.Y * GridSize.Z), (Index / GridSize.Z) % GridSize.Y, Index % GridSize.Z);
+    }
+
+    int32 GetTile(const FWFCCoordinate& Coord) const
+    {
+        const int32 Index = GetIndex(Coord);
+        return Index != INDEX_NONE ? TileIndices[Index] : INDEX_NONE;
+    }
+};
+
+//Blueprint通过UWFCResultLibrary访问瓦片结果
 USTRUCT(BlueprintType)
 struct FWFCGenerationResult
 {
@@ -261,14 +362,35 @@ struct FWFCGenerationResult
     UPROPERTY(BlueprintReadOnly)
     int32 IterationsUsed = 0;
 
-    UPROPERTY(BlueprintReadOnly)
-    TMap<FWFCCoordinate, int32> TileAssignments;
+    TSharedPtr<const FWFCTileAssignments> TileAssignments;
 
     UPROPERTY(BlueprintReadOnly)
-    TArray<FWFCCoordinate> FailedPositions;
+    float GenerationTimeSeconds = 0.0f;
 
     UPROPERTY(BlueprintReadOnly)
-    float GenerationTimeSeconds = 0.0f;
+    FWFCSolverStats Stats;
+
+    int32 GetPlacedTileCount() const { return TileAssignments ? TileAssignments->NumPlaced : 0; }
+    int32 GetFailedPositionCount() const { return TileAssignments ? TileAssignments->Num() - TileAssignments->NumPlaced : 0; }
+    int32 GetTileAt(const FWFCCoordinate& Coord) const { return TileAssignments ? TileAssignments->GetTile(Coord) : INDEX_NONE; }
+
+    //按线性格子顺序对每个已坍缩的格子调用Func(Coord, TileIndex)
+    template <typename FuncType>
+    void ForEachPlacedTile(FuncType&& Func) const
+    {
+        if (!TileAssignments)
+        {
+            return;
+        }
+        const TArray<int32>& Tiles = TileAssignments->TileIndices;
+        for (int32 Index = 0; Index < Tiles.Num(); Index++)
+        {
+            if (Tiles[Index] != INDEX_NONE)
+            {
+                Func(TileAssignments->GetCoordinate(Index), Tiles[Index]);
+            }
+        }
+    }
 };
 
 USTRUCT(BlueprintType)
@@ -304,6 +426,9 @@ struct FWFCVisualizationData
     TArray<FWFCVisualizationTile> Tiles;
 
     bool bShowEmptyTiles = false;
+    //按(网格, 材质)合并为HISM实例，而不是每格生成一个Actor
+    bool bUseInstancedMeshes = false;
+    bool bEnableInstanceCollision = false;
     FVector ParentLocation;
     FRotator ParentRotation;
 };
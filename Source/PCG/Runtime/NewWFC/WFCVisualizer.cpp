@@ -4,6 +4,7 @@
 #include "WFCVisualizer.h"
 
 #include "WFCTileSet.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
 #include "PCG/Runtime/PCGGameMode.h"
 
 
@@ -38,15 +39,86 @@ void AWFCVisualizer::Tick(float DeltaTime)
 	}
 }
 
-void AWFCVisualizer::StartVisualization(int ActorsPerFrame, const FWFCVisualizationData& VisualizationData)
+void AWFCVisualizer::StartVisualization(int ActorsPerFrame, const FWFCVisualizationData& VisualizationData,
+                                        float SpawnBudgetMicroseconds)
 {
 	this->ActorsPerFrame = ActorsPerFrame;
+	this->SpawnBudgetMicroseconds = SpawnBudgetMicroseconds;
+	AverageSpawnSeconds = 0.0;
 	this->VisualizationData = VisualizationData;
 	TotalTiles = VisualizationData.Tiles.Num();
 	SetActorLocation(VisualizationData.ParentLocation);
 	SetActorRotation(VisualizationData.ParentRotation);
 	CurrentTileIndex = 0;
 	bIsVisualizing = true;
+
+	//实例化模式一次性提交，下一帧即完成
+	if (VisualizationData.bUseInstancedMeshes)
+	{
+		for (UHierarchicalInstancedStaticMeshComponent* Instanced : CreateInstancedComponents(
+			     this, RootSceneComponent, VisualizationData.Tiles, VisualizationData.bShowEmptyTiles,
+			     VisualizationData.bEnableInstanceCollision, false))
+		{
+			InstancedComponents.Add(Instanced);
+		}
+		CurrentTileIndex = TotalTiles;
+		if (OnVisualizationProgress.IsBound())
+		{
+			OnVisualizationProgress.Broadcast(this, CurrentTileIndex, TotalTiles);
+		}
+	}
+}
+
+TArray<UHierarchicalInstancedStaticMeshComponent*> AWFCVisualizer::CreateInstancedComponents(
+	AActor* Owner, USceneComponent* Parent, const TArray<FWFCVisualizationTile>& Tiles, bool bShowEmptyTiles,
+	bool bEnableCollision, bool bWorldSpace)
+{
+	TArray<UHierarchicalInstancedStaticMeshComponent*> Components;
+	if (!Owner)
+	{
+		return Components;
+	}
+
+	TMap<TPair<UStaticMesh*, UMaterial*>, TArray<FTransform>> Groups;
+	for (const FWFCVisualizationTile& Tile : Tiles)
+	{
+		if (!Tile.StaticMesh || (Tile.Category == EWFCTileCategory::Empty && !bShowEmptyTiles))
+		{
+			continue;
+		}
+		Groups.FindOrAdd(TPair<UStaticMesh*, UMaterial*>(Tile.StaticMesh.Get(), Tile.Material.Get()))
+		      .Emplace(Tile.Rotation, Tile.Location);
+	}
+
+	for (const auto& [Key, Transforms] : Groups)
+	{
+		UHierarchicalInstancedStaticMeshComponent* Instanced = NewObject<UHierarchicalInstancedStaticMeshComponent>(Owner);
+		Instanced->SetupAttachment(Parent ? Parent : Owner->GetRootComponent());
+		Instanced->SetStaticMesh(Key.Key);
+		if (Key.Value)
+		{
+			Instanced->SetMaterial(0, Key.Value);
+		}
+
+		if (bEnableCollision)
+		{
+			Instanced->SetCollisionEnabled(ECollisionEnabled::QueryAndPhysics);
+			Instanced->SetCollisionProfileName(TEXT("BlockAllDynamic"));
+		}
+		else
+		{
+			Instanced->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		}
+
+		Instanced->RegisterComponent();
+		Owner->AddInstanceComponent(Instanced);
+		Instanced->AddInstances(Transforms, false, bWorldSpace);
+		Components.Add(Instanced);
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("WFCVisualizer: Created %d instanced components for %d tiles"), Components.Num(),
+	       Tiles.Num());
+	return Components;
 }
 
 void AWFCVisualizer::StopVisualization()
@@ -61,6 +133,15 @@ void AWFCVisualizer::ClearVisualization()
 		Actor->Destroy();
 	}
 	SpawnedActors.Empty();
+
+	for (UHierarchicalInstancedStaticMeshComponent* Instanced : InstancedComponents)
+	{
+		if (IsValid(Instanced))
+		{
+			Instanced->DestroyComponent();
+		}
+	}
+	InstancedComponents.Empty();
 }
 
 void AWFCVisualizer::EndPlay(const EEndPlayReason::Type EndPlayReason)
@@ -83,7 +164,8 @@ void AWFCVisualizer::OnTimeZeroGameover(UClass* ClassType, EGameOverType eType)
 
 void AWFCVisualizer::ProcessSpawnTasks()
 {
-	if (SpawnedActors.Num() >= TotalTiles)
+	//跳过的空瓦片不会生成Actor，按处理进度判断是否完成
+	if (CurrentTileIndex >= TotalTiles)
 	{
 		if (bIsVisualizing)
 		{
@@ -91,35 +173,60 @@ void AWFCVisualizer::ProcessSpawnTasks()
 		}
 		return;
 	}
+	const double FrameStart = FPlatformTime::Seconds();
+	const double BudgetSeconds = SpawnBudgetMicroseconds * 1e-6;
+	const bool bUseBudget = BudgetSeconds > 0.0;
 	int ActorSpawnedThisFrame = 0;
-	while (ActorSpawnedThisFrame < ActorsPerFrame && CurrentTileIndex < TotalTiles)
+	while (CurrentTileIndex < TotalTiles)
 	{
-		FWFCVisualizationTile& CurrentTile = VisualizationData.Tiles[CurrentTileIndex];
-		//如果tile类型为empty，则跳过
-		if (CurrentTile.Category != EWFCTileCategory::Empty)
+		if (bUseBudget)
 		{
-			SpawnTileActor(CurrentTile);
+			//按平均单个耗时预估，放不下下一个就留到下一帧，每帧至少处理一个
+			const double Elapsed = FPlatformTime::Seconds() - FrameStart;
+			if (ActorSpawnedThisFrame > 0 && Elapsed + AverageSpawnSeconds > BudgetSeconds)
+			{
+				break;
+			}
+		}
+		else if (ActorSpawnedThisFrame >= ActorsPerFrame)
+		{
+			break;
 		}
-		else if (VisualizationData.bShowEmptyTiles)
+
+		FWFCVisualizationTile& CurrentTile = VisualizationData.Tiles[CurrentTileIndex];
+		//如果tile类型为empty，则跳过
+		if (CurrentTile.Category != EWFCTileCategory::Empty || VisualizationData.bShowEmptyTiles)
 		{
+			const double SpawnStart = bUseBudget ? FPlatformTime::Seconds() : 0.0;
 			SpawnTileActor(CurrentTile);
+			if (bUseBudget)
+			{
+				const double SpawnSeconds = FPlatformTime::Seconds() - SpawnStart;
+				AverageSpawnSeconds = AverageSpawnSeconds > 0.0
+					                      ? FMath::Lerp(AverageSpawnSeconds, SpawnSeconds, 0.125)
+					                      : SpawnSeconds;
+			}
 		}
 		CurrentTileIndex++;
 		ActorSpawnedThisFrame++;
+	}
+
+	//进度每帧只通知一次
+	if (ActorSpawnedThisFrame > 0)
+	{
 		if (OnVisualizationProgress.IsBound())
 		{
 			OnVisualizationProgress.Broadcast(this, CurrentTileIndex, TotalTiles);
 		}
-		
-		if (CurrentTileIndex % 10 == 0) // 每10个Actor显示一次进度
+
+#if !UE_BUILD_SHIPPING
+		if (bShowProgress && GEngine)
 		{
-			if (GEngine)
-			{
-				FString ProgressText = FString::Printf(TEXT("WFC Progress: %d/%d (%.1f%%)"), 
-					CurrentTileIndex, TotalTiles, GetProgress() * 100.0f);
-				GEngine->AddOnScreenDebugMessage(1, 0.1f, FColor::Yellow, ProgressText);
-			}
+			GEngine->AddOnScreenDebugMessage(1, 0.1f, FColor::Yellow,
+				FString::Printf(TEXT("WFC Progress: %d/%d (%.1f%%)"), CurrentTileIndex, TotalTiles,
+				                GetProgress() * 100.0f));
 		}
+#endif
 	}
 }
 
@@ -163,14 +270,13 @@ void AWFCVisualizer::OnVisualizationFinished()
 {
 	bIsVisualizing = false;
 	
-	if (bShowProgress)
+#if !UE_BUILD_SHIPPING
+	if (bShowProgress && GEngine)
 	{
-		if (GEngine)
-		{
-			GEngine->AddOnScreenDebugMessage(-1, 5.0f, FColor::Green, 
-				FString::Printf(TEXT("WFC Visualization Complete! Spawned %d actors"), SpawnedActors.Num()));
-		}
+		GEngine->AddOnScreenDebugMessage(-1, 5.0f, FColor::Green,
+			FString::Printf(TEXT("WFC Visualization Complete! Spawned %d actors"), SpawnedActors.Num()));
 	}
+#endif
     
 	// 触发完成事件
 	if (OnVisualizationComplete.IsBound())
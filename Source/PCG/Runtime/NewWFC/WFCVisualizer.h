@@ -8,6 +8,7 @@
 #include "WFCVisualizer.generated.h"
 
 class UWFCTileSet;
+class UHierarchicalInstancedStaticMeshComponent;
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnVisualizationComplete, AWFCVisualizer*, Visualizer);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnVisualizationProgress, AWFCVisualizer*, Visualizer, int32, CompletedTasks, int32, TotalTasks);
 
@@ -29,7 +30,9 @@ public:
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 
-	void StartVisualization(int ActorsPerFrame, const FWFCVisualizationData& VisualizationData);
+	//SpawnBudgetMicroseconds大于0时按每帧时间预算生成，否则每帧固定生成ActorsPerFrame个
+	void StartVisualization(int ActorsPerFrame, const FWFCVisualizationData& VisualizationData,
+	                        float SpawnBudgetMicroseconds = 0.0f);
 	void StopVisualization();
 	void ClearVisualization();
 	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
@@ -41,18 +44,31 @@ public:
 	FOnVisualizationComplete OnVisualizationComplete;
 	FOnVisualizationProgress OnVisualizationProgress;
 
+	//在屏幕上显示生成进度，只在非Shipping版本中生效
+	UPROPERTY(EditAnywhere, Category = "Debug")
+	bool bShowProgress = false;
+
+	//按(网格, 材质)分组，每组创建一个挂在Parent下的HISM组件，bWorldSpace为false时Tile位置是相对Parent的
+	static TArray<UHierarchicalInstancedStaticMeshComponent*> CreateInstancedComponents(
+		AActor* Owner, USceneComponent* Parent, const TArray<FWFCVisualizationTile>& Tiles, bool bShowEmptyTiles,
+		bool bEnableCollision, bool bWorldSpace);
+
 protected:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Components")
 	USceneComponent* RootSceneComponent;
 	
 private:
 	int ActorsPerFrame = 5;
+	float SpawnBudgetMicroseconds = 0.0f;
+	//单个Tile生成耗时的滑动平均
+	double AverageSpawnSeconds = 0.0;
 	TArray<AActor*> SpawnedActors;
+	UPROPERTY()
+	TArray<TObjectPtr<UHierarchicalInstancedStaticMeshComponent>> InstancedComponents;
 	bool bIsVisualizing;
 	FWFCVisualizationData VisualizationData;
 	int TotalTiles;
 	int CurrentTileIndex;
-	bool bShowProgress = true;
 
 	void ProcessSpawnTasks();
 	AActor* SpawnTileActor(const FWFCVisualizationTile& Tile);